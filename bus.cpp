@@ -3,7 +3,9 @@
 #include "mos6502.h"
 #include "ricoh2c02.h"
 #include "mapper.h"
+#include "scheduler.h"
 
+#include <algorithm>
 #include <iostream>
 
 bool Bus::connectCPU(MOS6502 *cpu)
@@ -27,9 +29,17 @@ bool Bus::connectMapper(Mapper *mapper)
     if (mapper == nullptr)
         return false;
     this->mapper = mapper;
+    mapper->connectBus(this);
+    if (ppu)
+        ppu->setKernel(mapper->ppuKernel());
     return true;
 }
 
+void Bus::connectScheduler(Scheduler *scheduler)
+{
+    this->scheduler = scheduler;
+}
+
 bool Bus::connectJoypad1(Controller *joypad)
 {
     if (joypad == nullptr)
@@ -50,12 +60,25 @@ Bus::Bus()
 {
     RAM.resize(2_KB);
     CIRAM.resize(2_KB);
+    std::fill((uint8_t*)tilePalettes, (uint8_t*)tilePalettes + sizeof(tilePalettes), 0);
+    for (int slot = 0; slot < 4; slot++) // horizontal until a mapper says otherwise
+    {
+        nametable[slot] = CIRAM.data() + (slot >> 1) * 1_KB;
+        paletteMap[slot] = tilePalettes[slot >> 1];
+    }
     testRAM.resize(64_KB);
     cpu = nullptr;
     ppu = nullptr;
     mapper = nullptr;
+    scheduler = nullptr;
     joypad1 = nullptr;
     joypad2 = nullptr;
+    std::fill(readMap, readMap + 256, nullptr);
+    std::fill(writeMap, writeMap + 256, nullptr);
+    mapCpu(0x0000, 2_KB, RAM.data(), true); // internal RAM
+    mapCpu(0x0800, 2_KB, RAM.data(), true); // and its mirrors
+    mapCpu(0x1000, 2_KB, RAM.data(), true);
+    mapCpu(0x1800, 2_KB, RAM.data(), true);
 }
 
 bool Bus::connectAll(MOS6502 *cpu, RICOH2C02 *ppu, Mapper *mapper)
@@ -74,7 +97,35 @@ $4000–$4017	 $0018	NES APU and I/O registers
 $4018–$401F	 $0008	APU and I/O functionality that is normally disabled. See CPU Test Mode.
 $4020–$FFFF	 $BFE0	Cartridge space: PRG ROM, PRG RAM, and mapper registers
 */
-uint8_t Bus::cpuRead(uint16_t addr, bool readOnly)
+void Bus::mapCpu(uint16_t addr, uint32_t size, uint8_t *mem, bool writable)
+{
+    for (uint32_t offset = 0; offset < size; offset += 0x100)
+    {
+        readMap[(addr + offset) >> 8] = mem + offset;
+        writeMap[(addr + offset) >> 8] = writable ? mem + offset : nullptr;
+    }
+}
+
+void Bus::mapNametable(int slot, int page)
+{
+    if (page >= 2 && VRAM.empty())
+        VRAM.resize(2_KB);
+    uint8_t *mem = (page >= 2 ? VRAM.data() : CIRAM.data());
+    nametable[slot] = mem + (page & 0x01) * 1_KB;
+    paletteMap[slot] = tilePalettes[page];
+}
+
+void Bus::unmapCpu(uint16_t addr, uint32_t size)
+{
+    for (uint32_t offset = 0; offset < size; offset += 0x100)
+    {
+        readMap[(addr + offset) >> 8] = nullptr;
+        writeMap[(addr + offset) >> 8] = nullptr;
+    }
+}
+
+// only reached for pages that are not in the memory map
+uint8_t Bus::ioRead(uint16_t addr, bool readOnly)
 {
     if (addr <= 0x1FFF) // internal RAM
     {
@@ -82,6 +133,8 @@ uint8_t Bus::cpuRead(uint16_t addr, bool readOnly)
     }
     else if (addr <= 0x3FFF) // PPU registers
     {
+        if (scheduler && !readOnly)
+            scheduler->syncPPU();
         return ppu->readReg((addr & 0x0007) | 0x2000, readOnly);
     }
     else if (addr <= 0x4017) // NES APU and I/O registers
@@ -102,7 +155,7 @@ uint8_t Bus::cpuRead(uint16_t addr, bool readOnly)
     return 0;
 }
 
-void Bus::cpuWrite(uint16_t addr, uint8_t value)
+void Bus::ioWrite(uint16_t addr, uint8_t value)
 {
     if (addr <= 0x1FFF) // internal RAM
     {
@@ -110,12 +163,22 @@ void Bus::cpuWrite(uint16_t addr, uint8_t value)
     }
     else if (addr <= 0x3FFF) // PPU registers
     {
+        if (scheduler)
+            scheduler->syncPPU();
         ppu->writeReg(((addr & 0x0007) | 0x2000), value);
+        if (scheduler)
+            scheduler->updatePPUEvents();
     }
     else if (addr <= 0x4017) // NES APU and I/O registers
     {
         if (addr == 0x4014)
+        {
+            if (scheduler)
+                scheduler->syncPPU();
             cpu->OAMDMA(value, ppu);
+            if (scheduler)
+                scheduler->updatePPUEvents();
+        }
         if (addr == 0x4016)
         {
             if (joypad1)
@@ -130,24 +193,21 @@ void Bus::cpuWrite(uint16_t addr, uint8_t value)
     }
     else // Cartridge
     {
+        // bank switching changes what the ppu fetches from now on
+        if (scheduler)
+            scheduler->syncPPU();
         mapper->cpuWrite(addr, value);
     }
 }
 
 uint8_t Bus::ppuRead(uint16_t addr)
 {
-    if (addr <= 0x1FFF)
-    {
-        return mapper->ppuRead(addr);
-    }
-    // no need to do boundary check
-    else
-    {
-        uint16_t maddr = mapper->mirrored(addr);
-        if (maddr >= 0x0800)
-            maddr -= 0x0400;
-        return CIRAM[maddr];
-    }
+    return ppuRead<Mapper>(addr);
+}
+
+const uint8_t *Bus::tileRow(uint16_t addr, bool flip)
+{
+    return tileRow<Mapper>(addr, flip);
 }
 
 void Bus::ppuWrite(uint16_t addr, uint8_t value)
@@ -158,19 +218,38 @@ void Bus::ppuWrite(uint16_t addr, uint8_t value)
     }
     else
     {
-        uint16_t maddr = mapper->mirrored(addr);
-        if (maddr >= 0x0800)
-            maddr -= 0x0400;
-        CIRAM[maddr] = value;
+        nametable[(addr >> 10) & 0x03][addr & 0x03FF] = value;
+        if ((addr & 0x03FF) >= 0x03C0)
+            updatePalettes(paletteMap[(addr >> 10) & 0x03], addr & 0x003F, value);
+    }
+}
+
+// one attribute byte covers 4x4 tiles, 2 bits for each 2x2 quadrant
+// 76543210
+// ||||||++- top left
+// ||||++--- top right
+// ||++----- bottom left
+// ++------- bottom right
+void Bus::updatePalettes(uint8_t *palettes, uint16_t attrOffset, uint8_t value)
+{
+    int top = ((attrOffset >> 3) << 2); // first tile row of the block
+    int left = ((attrOffset & 0x07) << 2);
+    for (int y = top; y < top + 4; y++)
+    {
+        for (int x = left; x < left + 4; x++)
+        {
+            int shift = ((((y >> 1) & 0x01) << 2) | (((x >> 1) & 0x01) << 1));
+            palettes[(y << 5) | x] = ((value >> shift) & 0x03);
+        }
     }
 }
 
 void Bus::nmi()
 {
-    cpu->nmi();
+    cpu->setNMI();
 }
 
-void Bus::irq()
+void Bus::irq(bool active)
 {
-    cpu->irq();
+    cpu->setIRQ(active);
 }
@@ -8,6 +8,7 @@
 class MOS6502;
 class RICOH2C02;
 class Mapper;
+class Scheduler;
 
 class Bus // the bus for cpu and ppu
 {
@@ -15,11 +16,30 @@ private:
     MOS6502 *cpu;
     RICOH2C02 *ppu;
     Mapper *mapper;
+    Scheduler *scheduler; // optional, lets the ppu lag behind the cpu
     Controller *joypad1;
     Controller *joypad2;
     // assume that cartridge can only be accessed through mapper
     std::vector<uint8_t> RAM; // 2KB
     std::vector<uint8_t> CIRAM; // 2KB
+    std::vector<uint8_t> VRAM; // 2KB more on four-screen cartridges, allocated when first mapped
+    // $2000-$2FFF in 1KB slots, set by the mapper whenever its mirroring changes
+    // $3000-$3EFF mirrors them
+    uint8_t *nametable[4];
+    // https://www.nesdev.org/wiki/PPU_attribute_tables
+    // the 2-bit palette of every tile of the 4 VRAM pages, expanded from the attribute bytes as they are written
+    // indexed like the nametable itself, coarse Y * 32 + coarse X, rows 30 and 31 included
+    uint8_t tilePalettes[4][32 * 32];
+    uint8_t *paletteMap[4]; // tilePalettes of the page in each nametable slot
+    void updatePalettes(uint8_t *palettes, uint16_t attrOffset, uint8_t value); // attribute byte written
+private:
+    // cpu memory map, one entry per 256-byte page
+    // RAM, PRG-RAM and PRG-ROM resolve to plain pointers,
+    // null entries fall back to the handlers below (PPU/APU/IO registers, mapper registers)
+    const uint8_t *readMap[256];
+    uint8_t *writeMap[256];
+    uint8_t ioRead(uint16_t addr, bool readOnly);
+    void ioWrite(uint16_t addr, uint8_t value);
 private:
     std::vector<uint8_t> testRAM;
     uint8_t keyLatch1;
@@ -33,12 +53,65 @@ public:
     bool connectAll(MOS6502 *cpu, RICOH2C02 *ppu, Mapper *mapper);
     bool connectJoypad1(Controller *joypad);
     bool connectJoypad2(Controller *joypad);
+    void connectScheduler(Scheduler *scheduler);
     uint8_t cpuRead(uint16_t addr, bool readOnly);
     void cpuWrite(uint16_t addr, uint8_t value); // write a byte
+    void mapCpu(uint16_t addr, uint32_t size, uint8_t *mem, bool writable); // map [addr, addr + size) onto mem
+    void unmapCpu(uint16_t addr, uint32_t size); // let [addr, addr + size) go through the handlers again
+    void mapNametable(int slot, int page); // slot 0-3: $2000, $2400, $2800, $2C00, page 0-1: CIRAM, 2-3: cartridge VRAM
     uint8_t ppuRead(uint16_t addr);
+    template <class M> uint8_t ppuRead(uint16_t addr); // same as above, but M is the concrete mapper type
+    const uint8_t *tileRow(uint16_t addr, bool flip); // decoded pattern row, see Mapper::tileRow
+    template <class M> const uint8_t *tileRow(uint16_t addr, bool flip);
     void ppuWrite(uint16_t addr, uint8_t value); // write a byte
-    void nmi();
-    void irq();
+    uint8_t tilePalette(uint16_t addr); // background palette of the tile at nametable address addr, no attribute fetch needed
+    void nmi(); // raise nmi on the cpu
+    void irq(bool active); // drive the cpu irq line
 };
 
+inline uint8_t Bus::cpuRead(uint16_t addr, bool readOnly)
+{
+    const uint8_t *page = readMap[addr >> 8];
+    if (page)
+        return page[addr & 0xFF];
+    return ioRead(addr, readOnly);
+}
+
+inline void Bus::cpuWrite(uint16_t addr, uint8_t value)
+{
+    uint8_t *page = writeMap[addr >> 8];
+    if (page)
+        page[addr & 0xFF] = value;
+    else
+        ioWrite(addr, value);
+}
+
+// no virtual call if M is a final mapper class
+// instantiated by the ppu rendering loop, which includes the mapper headers
+template <class M>
+inline uint8_t Bus::ppuRead(uint16_t addr)
+{
+    M *m = static_cast<M *>(mapper);
+    if (addr <= 0x1FFF)
+    {
+        return m->ppuRead(addr);
+    }
+    // no need to do boundary check
+    else
+    {
+        return nametable[(addr >> 10) & 0x03][addr & 0x03FF];
+    }
+}
+
+inline uint8_t Bus::tilePalette(uint16_t addr)
+{
+    return paletteMap[(addr >> 10) & 0x03][addr & 0x03FF];
+}
+
+template <class M>
+inline const uint8_t *Bus::tileRow(uint16_t addr, bool flip)
+{
+    return static_cast<M *>(mapper)->tileRow(addr, flip);
+}
+
 #endif // BUS_H
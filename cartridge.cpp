@@ -6,133 +6,235 @@
 
 #include <algorithm>
 #include <iostream>
-#include <fstream>
 #include <string>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 
 
 Cartridge::Cartridge()
 {
     std::fill(header, header + 16, 0);
+    PRG_RAM = PRG_ROM = CHR_RAM = CHR_ROM = nullptr;
+    prgRamSize = prgRomSize = chrRamSize = chrRomSize = 0;
+    mapperID = 0;
+    submapperID = 0;
+    region = 0;
+    image = nullptr;
+    imageSize = 0;
+    mapper = nullptr;
 }
 
-Cartridge::Cartridge(const std::string &path)
+Cartridge::Cartridge(const std::string &path) : Cartridge()
 {
-    std::fill(header, header + 16, 0);
+
 }
 
 Cartridge::~Cartridge()
 {
-
+    unmapImage();
 }
 
 void Cartridge::load(const std::string &path)
 {
-    // todo:
-    // 1. read ines game pak
+    // 1. map ines game pak
     // 2. evaluate ines pak
-    // 4. dump binary code into storage
-    // 3. configure mapper(bank switching and nametable mirroring)
+    // 3. point rom banks into the mapping and allocate ram
+    // 4. configure mapper(bank switching and nametable mirroring)
+
+    unmapImage();
+    mapImage(path);
 
     // 16-byte header
-    std::ifstream rom(path, std::ios::binary | std::ios::in);
-    if (!rom)
-    {
-        rom.close();
-        throw std::string("Cannot open rom ") + path;
-    }
-    rom.read(reinterpret_cast<char*>(header), 16);
+    if (imageSize < 16)
+        throw std::string("Rom is too small ") + path;
+    std::copy_n(image, 16, header);
     // Check magic number
     if (magic1 != 0x4E || magic2 != 0x45 || magic3 != 0x53 || magic4 != 0x1A)
-    {
-        rom.close();
         throw std::string("Magic number not match");
-    }
-    if (version2 == 2)
+    parseHeader();
+    if (!prgRomSize)
+        throw std::string("Rom has no PRG ROM ") + path;
+
+    size_t offset = 16;
+    size_t trainerSize = hasTrainer ? 512 : 0;
+    if (imageSize < offset + trainerSize + prgRomSize + chrRomSize)
+        throw std::string("Rom is truncated ") + path;
+    // trainer(is present), copied into PRG RAM once the arena exists
+    const uint8_t *trainer = image + offset;
+    offset += trainerSize;
+    // PGR_ROM and CHR_ROM are used in place, the mapping is never written
+    PRG_ROM = const_cast<uint8_t*>(image + offset);
+    offset += prgRomSize;
+    CHR_ROM = chrRomSize ? const_cast<uint8_t*>(image + offset) : nullptr;
+    offset += chrRomSize;
+    // ROMS for PlayChoice
+
+    // additional 128-byte title
+
+    // init storage and mapper
+    initArena();
+    if (hasTrainer)
+        std::copy_n(trainer, trainerSize, PRG_RAM + 0x1000); // $7000-$71FF
+    initMapper();
+    std::cout << std::endl << "Cartridge loaded" << std::endl;
+}
+
+void Cartridge::mapImage(const std::string &path)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw std::string("Cannot open rom ") + path;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
     {
-        rom.close();
-        throw std::string("Do not support iNes 2.0 format");
+        CloseHandle(file);
+        throw std::string("Cannot map rom ") + path;
     }
-    // A general rule of thumb:
-    // if the last 4 bytes of byte 10 are not all zero,
-    // and the header is not marked for NES 2.0 format,
-    // an emulator should either mask off the upper 4 bits
-    // of the mapper number or simply refuse to load the ROM.
-    if ((byte10Unused & 0x0F) && version2 != 2)
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file); // the mapping keeps the file open
+    if (!mapping)
+        throw std::string("Cannot map rom ") + path;
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping); // the view keeps the mapping alive
+    if (!view)
+        throw std::string("Cannot map rom ") + path;
+    imageSize = size.QuadPart;
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::string("Cannot open rom ") + path;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0)
     {
-        mapperID &= 0x0F;
-        // throw std::string("Unrecognized ROM format(byte 10 in header is set)");
+        close(fd);
+        throw std::string("Cannot map rom ") + path;
     }
-    std::cout << "PRG ROM(16KB unit) count: " << (int)nPRG_ROM << std::endl;
-    std::cout << "CHR ROM(8KB unit) count: " << (int)nCHR_ROM << std::endl;
-    if (fourScreen)
-        std::cout << "ROM is using four-screen mirroring" << std::endl;
-    else
-        std::cout << "ROM is using " << (mirrorMode ? "vertical" : "horizontal") << " mirroring" << std::endl;
-    mapperID = (mapperH4 << 4) + mapperL4;
-    std::cout << "Mapper ID is " << (int)mapperID << std::endl;
-    std::cout << "PRG RAM(8KB unit) count: " << (int)nPRG_RAM << std::endl;
-    std::cout << "TV system is " << (TV_system ? "PAL" : "NTSC") << std::endl;
+    void *view = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if (view == MAP_FAILED)
+        throw std::string("Cannot map rom ") + path;
+    imageSize = st.st_size;
+#endif
+    image = static_cast<const uint8_t*>(view);
+}
 
-    // init storage and mapper
-    std::cout << std::endl << "Cartridge loaded" << std::endl;
-    initROM();
-    initRAM();
-    initMapper();
+void Cartridge::unmapImage()
+{
+    if (!image)
+        return;
+#ifdef _WIN32
+    UnmapViewOfFile(image);
+#else
+    munmap(const_cast<uint8_t*>(image), imageSize);
+#endif
+    image = nullptr;
+    imageSize = 0;
+    PRG_ROM = CHR_ROM = nullptr;
+}
 
-    // trainer(is present)
-    if (hasTrainer)
-        trainer.resize(512);
+// NES 2.0: if the MSB nibble is $F, the LSB byte is in exponent-multiplier notation
+// EEEEEEMM: 2^E * (MM*2+1) bytes
+uint32_t Cartridge::romSize(uint8_t lsb, uint8_t msb, uint32_t unit)
+{
+    if (msb == 0x0F)
+    {
+        if ((lsb >> 2) > 28) // larger than any file we could map, let the size check reject it
+            return UINT32_MAX;
+        return (1u << (lsb >> 2)) * ((lsb & 0x03) * 2 + 1);
+    }
+    return ((msb << 8) | lsb) * unit;
+}
 
-    char buf[16_KB];
-    // PGR_ROM
-    if (nPRG_ROM)
+void Cartridge::parseHeader()
+{
+    if (version2 == 2)
     {
-        std::cout << "Reading PRG ROM..." << std::endl;
-        for (int i = 0; i < nPRG_ROM; i++)
-        {
-            rom.read(buf, 16_KB);
-            std::copy_n(buf, 16_KB, PRG_ROM[i].begin());
-        }
+        std::cout << "ROM is in NES 2.0 format" << std::endl;
+        mapperID = (mapperMSB << 8) | (mapperH4 << 4) | mapperL4;
+        submapperID = submapper;
+        prgRomSize = romSize(nPRG_ROM, nPRG_ROM_MSB, 16_KB);
+        chrRomSize = romSize(nCHR_ROM, nCHR_ROM_MSB, 8_KB);
+        prgRamSize = (prgRamShift ? 64 << prgRamShift : 0) + (prgNvramShift ? 64 << prgNvramShift : 0);
+        chrRamSize = (chrRamShift ? 64 << chrRamShift : 0) + (chrNvramShift ? 64 << chrNvramShift : 0);
+        region = timing;
     }
-    // CHR_ROM
-    if (nCHR_ROM)
+    else
     {
-        std::cout << "Reading CHR ROM..." << std::endl;
-        for (int i = 0; i < nCHR_ROM; i++)
-        {
-            rom.read(buf, 8_KB);
-            std::copy_n(buf, 8_KB, CHR_ROM[i].begin());
-        }
+        // A general rule of thumb:
+        // if the last 4 bytes are not all zero,
+        // and the header is not marked for NES 2.0 format,
+        // an emulator should either mask off the upper 4 bits
+        // of the mapper number or simply refuse to load the ROM.
+        bool dirty = byte12Unused || byte13Unused || byte14Unused || byte15Unused;
+        mapperID = dirty ? mapperL4 : (mapperH4 << 4) | mapperL4;
+        submapperID = 0;
+        prgRomSize = nPRG_ROM * 16_KB;
+        chrRomSize = nCHR_ROM * 8_KB;
+        prgRamSize = 8_KB; // iNES 1.0 roms rarely set byte 8, always provide 8KB
+        chrRamSize = nCHR_ROM ? 0 : 8_KB;
+        region = TV_system;
     }
-    // ROMS for PlayChoice
-
-    // additional 128-byte title
+    // round ram up to whole 8KB banks, mappers and the bus work in that granularity
+    prgRamSize = (prgRamSize + 8_KB - 1) / 8_KB * 8_KB;
+    chrRamSize = (chrRamSize + 8_KB - 1) / 8_KB * 8_KB;
+    if (!chrRomSize && !chrRamSize)
+        chrRamSize = 8_KB;
+    if (hasTrainer && !prgRamSize) // the trainer lives at $7000
+        prgRamSize = 8_KB;
 
-    rom.close();
+    static const char *regions[] = {"NTSC", "PAL", "multiple-region", "Dendy"};
+    std::cout << "PRG ROM size: " << prgRomSize / 1_KB << "KB" << std::endl;
+    std::cout << "CHR ROM size: " << chrRomSize / 1_KB << "KB" << std::endl;
+    if (fourScreen)
+        std::cout << "ROM is using four-screen mirroring" << std::endl;
+    else
+        std::cout << "ROM is using " << (mirrorMode ? "vertical" : "horizontal") << " mirroring" << std::endl;
+    std::cout << "Mapper ID is " << (int)mapperID << "." << (int)submapperID << std::endl;
+    std::cout << "PRG RAM size: " << prgRamSize / 1_KB << "KB" << std::endl;
+    std::cout << "CHR RAM size: " << chrRamSize / 1_KB << "KB" << std::endl;
+    std::cout << "TV system is " << regions[region] << std::endl;
 }
 
-void Cartridge::initRAM()
+void Cartridge::initArena()
 {
-    std::cout << "Initializing PRG RAM..." << std::endl;
-    PRG_RAM.resize(8_KB, 0);
-    nPRG_RAM = 1;
-    std::cout << "Initializing CHR RAM..." << std::endl;
-    if (!nCHR_ROM)
+    std::cout << "Initializing CHR RAM and PRG RAM..." << std::endl;
+    // NES 2.0 can describe ROMs smaller than one 8KB PRG / 1KB CHR window,
+    // those get a whole window in the arena with the image repeated through it
+    uint32_t prgMirrorSize = prgRomSize < 8_KB ? 8_KB : 0;
+    uint32_t chrMirrorSize = (chrRomSize && chrRomSize < 1_KB) ? 1_KB : 0;
+    // every region but the CHR mirror is a multiple of 8KB and it comes last, so aligning the base keeps all banks page aligned
+    const size_t align = 4_KB;
+    arena.assign(chrRamSize + prgRamSize + prgMirrorSize + chrMirrorSize + align, 0);
+    uint8_t *base = arena.data() + ((align - reinterpret_cast<uintptr_t>(arena.data()) % align) % align);
+    CHR_RAM = chrRamSize ? base : nullptr;
+    PRG_RAM = prgRamSize ? base + chrRamSize : nullptr;
+    if (prgMirrorSize)
+    {
+        PRG_ROM = mirrorRom(base + chrRamSize + prgRamSize, PRG_ROM, prgRomSize, prgMirrorSize);
+        prgRomSize = prgMirrorSize;
+    }
+    if (chrMirrorSize)
     {
-        for (int i = 0; i < 32; i++)
-            CHR_RAM[i].resize(8_KB, 0);
+        CHR_ROM = mirrorRom(base + chrRamSize + prgRamSize + prgMirrorSize, CHR_ROM, chrRomSize, chrMirrorSize);
+        chrRomSize = chrMirrorSize;
     }
 }
 
-void Cartridge::initROM()
+// fills window bytes at dst with copies of the size byte long image, returns dst
+uint8_t *Cartridge::mirrorRom(uint8_t *dst, const uint8_t *src, uint32_t size, uint32_t window)
 {
-    std::cout << "Initializing PRG ROM..." << std::endl;
-    for (int i = 0; i < nPRG_ROM; i++)
-        PRG_ROM[i].resize(16_KB, 0);
-    std::cout << "Initializing CHR ROM..." << std::endl;
-    for (int i = 0; i < nCHR_ROM; i++)
-        CHR_ROM[i].resize(8_KB, 0);
+    for (uint32_t offset = 0; offset < window; offset += size)
+        std::copy_n(src, std::min(size, window - offset), dst + offset);
+    return dst;
 }
 
 void Cartridge::initMapper()
@@ -7,14 +7,20 @@
 
 class Mapper;
 
-class Cartridge // iNES 1.0 format
+class Cartridge // iNES 1.0 and NES 2.0 format
 {
 public:
-    std::vector<uint8_t> PRG_RAM;       // CPU $6000–$7FFF
-    std::vector<uint8_t> PRG_ROM[32];   // CPU $8000–$FFFF
-    std::vector<uint8_t> CHR_RAM[32];   // PPU $0000-$1FFF
-    std::vector<uint8_t> CHR_ROM[32];   // PPU $0000-$1FFF
-    std::vector<uint8_t> trainer;
+    // PRG ROM and CHR ROM point straight into the read-only file mapping (into the arena if smaller than a bank window),
+    // all RAM of the cartridge lives in one contiguous, aligned arena
+    // mappers only keep bank window pointers into them
+    uint8_t *PRG_RAM;       // CPU $6000–$7FFF
+    uint8_t *PRG_ROM;       // CPU $8000–$FFFF, read-only mapping
+    uint8_t *CHR_RAM;       // PPU $0000-$1FFF
+    uint8_t *CHR_ROM;       // PPU $0000-$1FFF, read-only mapping
+    uint32_t prgRamSize;
+    uint32_t prgRomSize;
+    uint32_t chrRamSize;
+    uint32_t chrRomSize;
     // for PlayChoice, usually not in use
     std::vector<uint8_t> INST_ROM;
     std::vector<uint8_t> PROM;
@@ -78,9 +84,58 @@ public:
             uint8_t byte14Unused;
             uint8_t byte15Unused;
         };
+        struct // NES 2.0 meaning of byte 8-15, only valid if version2 == 2
+        {
+            uint8_t nes2Common[8];
+            /* Byte 8
+            76543210
+            ||||||||
+            ||||++++- Mapper number D8..D11
+            ++++----- Submapper number
+            */
+            uint8_t mapperMSB : 4;
+            uint8_t submapper : 4;
+            /* Byte 9
+            76543210
+            ||||||||
+            ||||++++- PRG-ROM size MSB
+            ++++----- CHR-ROM size MSB
+            */
+            uint8_t nPRG_ROM_MSB : 4;
+            uint8_t nCHR_ROM_MSB : 4;
+            /* Byte 10, 11
+            76543210
+            ||||||||
+            ||||++++- PRG-RAM (volatile) / CHR-RAM shift count
+            ++++----- PRG-NVRAM/EEPROM (non-volatile) / CHR-NVRAM shift count
+            If the shift count is zero, there is no RAM.
+            If the shift count is non-zero, the actual size is "64 << shift count" bytes.
+            */
+            uint8_t prgRamShift : 4;
+            uint8_t prgNvramShift : 4;
+            uint8_t chrRamShift : 4;
+            uint8_t chrNvramShift : 4;
+            /* Byte 12
+            76543210
+            ||||||||
+            ||||||++- CPU/PPU timing mode
+            ||||||     0: RP2C02 ("NTSC NES")
+            ||||||     1: RP2C07 ("Licensed PAL NES")
+            ||||||     2: Multiple-region
+            ||||||     3: UA6538 ("Dendy")
+            ++++++--- Reserved, set to zero
+            */
+            uint8_t timing : 2;
+            uint8_t nes2Byte12Unused : 6;
+            uint8_t nes2Byte13;     // Vs. System type or extended console type
+            uint8_t nMiscROM;       // number of miscellaneous ROMs present
+            uint8_t nes2Byte15;     // default expansion device
+        };
         uint8_t header[16];
     };
-    uint8_t mapperID;
+    uint16_t mapperID;
+    uint8_t submapperID;
+    uint8_t region; // same encoding as the NES 2.0 timing field
     Mapper *mapper;
 
 public:
@@ -91,8 +146,15 @@ public:
     void load(const std::string &path); // load nes rom from the file that path is pointing at
 
 private:
-    void initRAM();
-    void initROM();
+    const uint8_t *image; // read-only mapping of the whole rom file
+    size_t imageSize;
+    std::vector<uint8_t> arena;
+    void mapImage(const std::string &path);
+    void unmapImage();
+    void parseHeader();
+    static uint32_t romSize(uint8_t lsb, uint8_t msb, uint32_t unit); // NES 2.0 PRG/CHR ROM size
+    void initArena(); // also takes over PRG/CHR ROMs smaller than one bank window
+    static uint8_t *mirrorRom(uint8_t *dst, const uint8_t *src, uint32_t size, uint32_t window);
     void initMapper();
 };
 
@@ -19,7 +19,7 @@ void Worker::doWork()
     int count = 0;
     while (parent->running)
     {
-        parent->cpu->clock();
+        parent->scheduler->clock();
         emit updateComponentSignal();
         std::this_thread::sleep_for(std::chrono::milliseconds(2));
     }
@@ -34,12 +34,13 @@ DebuggerWindow::DebuggerWindow(QWidget *parent) :
     curNametable = 0;
 }
 
-DebuggerWindow::DebuggerWindow(QWidget *parent, Bus *bus, MOS6502 *cpu, RICOH2C02 *ppu)
+DebuggerWindow::DebuggerWindow(QWidget *parent, Bus *bus, MOS6502 *cpu, RICOH2C02 *ppu, Scheduler *scheduler)
     : parent(parent)
     , ui(new Ui::DebuggerWindow)
     , bus(bus)
     , cpu(cpu)
     , ppu(ppu)
+    , scheduler(scheduler)
 {
     ui->setupUi(this);
     buttonGroup = new QButtonGroup();
@@ -75,6 +76,7 @@ void DebuggerWindow::changeNametable(QAbstractButton *button)
 void DebuggerWindow::updateStat()
 {
     static unsigned char paletteImage[32 * 3];
+    static unsigned char displayImage[240 * 256 * 3];
     // CPU
     ui->lineEditPC->setText(QString::number(cpu->PC, 16).toUpper());
     ui->lineEditA->setText(QString::number(cpu->A, 16).toUpper());
@@ -125,12 +127,13 @@ void DebuggerWindow::updateStat()
     stat += QString("fetched: 0x%1 ").arg(cpu->fetched, 2, 16, QChar('0'));
     stat += QString("addr_abs: 0x%1 ").arg(cpu->addr_abs, 4, 16, QChar('0'));
     stat += QString("IR: 0x%1 ").arg(cpu->IR, 2, 16, QChar('0'));
-    stat += QString("op_name: ") + QString(cpu->lookup[cpu->IR].name.c_str());
+    stat += QString("op_name: ") + QString(MOS6502::mnemonic(cpu->IR));
     stat += QString(" total_cycls: %1").arg(cpu->total_cycles);
     ui->displayStat->insertPlainText(stat);
 
     // PPU output
-    QImage image(ppu->rendered(), 256, 240, QImage::Format_RGB888);
+    ppu->rendered(displayImage); // keeps the previous picture if no frame finished since
+    QImage image(displayImage, 256, 240, QImage::Format_RGB888);
     QPixmap pixmap1 = QPixmap::fromImage(image);
     ui->labelDisplay->setPixmap(pixmap1);
     // Palette
@@ -179,12 +182,9 @@ void DebuggerWindow::step()
 void DebuggerWindow::both()
 {
     uint8_t temp = bus->cpuRead(0x03D0, true);
-    cpu->clock();
+    scheduler->clock(); // 1 cpu cycle, ppu follows with 3
     if (temp != 0xf0 && bus->cpuRead(0x03D0, true) == 0xf0)
         std::cout << "fucking PC is " << std::hex << cpu->PC << std::endl;
-    ppu->clock();
-    ppu->clock();
-    ppu->clock();
 }
 
 void DebuggerWindow::clock()
@@ -255,6 +255,7 @@ void DebuggerWindow::stop()
 void DebuggerWindow::reset()
 {
     cpu->reset();
+    scheduler->reset();
 
     updateStat();
 }
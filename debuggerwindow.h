@@ -4,6 +4,7 @@
 #include <QWidget>
 #include "mos6502.h"
 #include "ricoh2c02.h"
+#include "scheduler.h"
 #include <thread>
 #include <QAbstractButton>
 #include <QButtonGroup>
@@ -38,13 +39,14 @@ class DebuggerWindow : public QWidget
 public:
     QWidget *parent;
     explicit DebuggerWindow(QWidget *parent = nullptr);
-    explicit DebuggerWindow(QWidget *parent, Bus *bus, MOS6502 *cpu, RICOH2C02 *ppu);
+    explicit DebuggerWindow(QWidget *parent, Bus *bus, MOS6502 *cpu, RICOH2C02 *ppu, Scheduler *scheduler);
     ~DebuggerWindow();
 
 public:
     Bus *bus;
     MOS6502 *cpu;
     RICOH2C02 *ppu;
+    Scheduler *scheduler;
 private:
     QButtonGroup *buttonGroup;
     int curNametable;
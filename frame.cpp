@@ -1,25 +1,152 @@
 #include "frame.h"
 #include <cstring>
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FRAME_AVX2
+#endif
+
 Frame::Frame()
 {
-    memset(framebuffer, 0, sizeof(framebuffer));
-    bufferNow = 0;
+    memset(pixels, BLACK, sizeof(pixels));
+    memset(emphasis, 0, sizeof(emphasis));
+    memset(sequence, 0, sizeof(sequence));
+    back = 0;
+    ready = 1;
+    front = 2;
+    published = 0;
 }
 
-void Frame::setColor(int x, int y, unsigned char r, unsigned char g, unsigned char b)
+void Frame::swapBuffer()
 {
-    framebuffer[bufferNow][x][y][0] = r;
-    framebuffer[bufferNow][x][y][1] = g;
-    framebuffer[bufferNow][x][y][2] = b;
+    sequence[back] = ++published;
+    // release the pixels of back together with the index, get whatever the consumer left behind
+    back = (ready.exchange(back | FRESH, std::memory_order_acq_rel) & 0x03);
 }
 
-void Frame::swapBuffer()
+bool Frame::acquire()
+{
+    if (!(ready.load(std::memory_order_acquire) & FRESH))
+        return false;
+    front = (ready.exchange(front, std::memory_order_acq_rel) & 0x03);
+    return true;
+}
+
+uint64_t Frame::frameNumber()
+{
+    return sequence[front];
+}
+
+const uint8_t *Frame::getIndices()
+{
+    return (const uint8_t *)pixels[front];
+}
+
+const uint8_t *Frame::getEmphasis()
+{
+    return emphasis[front];
+}
+
+int Frame::bytesPerPixel(Format format)
+{
+    switch (format)
+    {
+    case FORMAT_RGBA8888:
+        return 4;
+    case FORMAT_RGB565:
+        return 2;
+    default:
+        return 3;
+    }
+}
+
+// lut holds every colour already packed in the output format, low byte first
+static void convertLine(const uint8_t *src, unsigned char *dst, const uint32_t *lut, Frame::Format format)
+{
+    switch (format)
+    {
+    case Frame::FORMAT_RGBA8888:
+        for (int x = 0; x < 256; x++)
+            memcpy(dst + x * 4, &lut[src[x]], 4);
+        break;
+    case Frame::FORMAT_RGB565:
+        for (int x = 0; x < 256; x++)
+        {
+            uint16_t c = lut[src[x]];
+            memcpy(dst + x * 2, &c, 2);
+        }
+        break;
+    default:
+        for (int x = 0; x < 256; x++)
+        {
+            uint32_t c = lut[src[x]];
+            dst[x * 3] = c;
+            dst[x * 3 + 1] = (c >> 8);
+            dst[x * 3 + 2] = (c >> 16);
+        }
+        break;
+    }
+}
+
+#ifdef FRAME_AVX2
+// 8 pixels per step: widen the indices, gather their colours, then pack down to the output format
+__attribute__((target("avx2")))
+static void convertLineAVX2(const uint8_t *src, unsigned char *dst, const uint32_t *lut, Frame::Format format)
 {
-    bufferNow = !bufferNow;
+    const __m256i drop = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                          0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+    for (int x = 0; x < 256; x += 8)
+    {
+        __m256i ind = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + x)));
+        __m256i colour = _mm256_i32gather_epi32((const int *)lut, ind, 4);
+        if (format == Frame::FORMAT_RGBA8888)
+            _mm256_storeu_si256((__m256i *)(dst + x * 4), colour);
+        else if (format == Frame::FORMAT_RGB565)
+        {
+            // packus works per 128-bit lane, so put the two lanes' results back together
+            __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(colour, colour), 0x08);
+            _mm_storeu_si128((__m128i *)(dst + x * 2), _mm256_castsi256_si128(packed));
+        }
+        else
+        {
+            // 12 bytes left in each lane, the second store covers the tail of the first one
+            __m256i packed = _mm256_shuffle_epi8(colour, drop);
+            __m128i low = _mm256_castsi256_si128(packed);
+            __m128i high = _mm256_extracti128_si256(packed, 1);
+            unsigned char *out = dst + x * 3;
+            _mm_storeu_si128((__m128i *)out, low);
+            _mm_storel_epi64((__m128i *)(out + 12), high);
+            uint32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(high, 8));
+            memcpy(out + 20, &tail, 4);
+        }
+    }
 }
+#endif
 
-unsigned char *Frame::getRawImage()
+void Frame::convert(unsigned char *out, Format format, const uint8_t (*colours)[64][3])
 {
-    return (unsigned char *)framebuffer[!bufferNow];
+    uint32_t lut[8][64];
+    for (int e = 0; e < 8; e++)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            uint32_t r = colours[e][i][0], g = colours[e][i][1], b = colours[e][i][2];
+            if (format == FORMAT_RGB565)
+                lut[e][i] = (((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3));
+            else
+                lut[e][i] = (r | (g << 8) | (b << 16) | (format == FORMAT_RGBA8888 ? 0xFF000000 : 0));
+        }
+    }
+    void (*kernel)(const uint8_t *, unsigned char *, const uint32_t *, Format) = convertLine;
+#ifdef FRAME_AVX2
+    // sse2 has no gather or byte shuffle, machines without avx2 take the table loop
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2)
+        kernel = convertLineAVX2;
+#endif
+    int pitch = 256 * bytesPerPixel(format);
+    const uint8_t (*src)[256] = pixels[front];
+    const uint8_t *lineEmphasis = emphasis[front];
+    for (int y = 0; y < 240; y++)
+        kernel(src[y], out + y * pitch, lut[lineEmphasis[y] & 0x07], format);
 }
@@ -1,17 +1,65 @@
 #ifndef FRAME_H
 #define FRAME_H
 
+#include <atomic>
+#include <cstdint>
 
 class Frame
 {
+public:
+    // what the presentation side can ask convert() for
+    enum Format
+    {
+        FORMAT_RGB888,
+        FORMAT_RGBA8888,
+        FORMAT_RGB565
+    };
+    static constexpr uint8_t BLACK = 0x0F; // colour index written when rendering is off for a pixel
+
 private:
-    unsigned char framebuffer[2][240][256][3];
-    int bufferNow;
+    // the ppu only writes 6-bit colour indices, one byte per pixel, [y][x]
+    // emphasis bits (PPUMASK bit 5-7) are kept per scanline, mid-line changes take the last one,
+    // greyscale is already applied to the index
+    uint8_t pixels[3][240][256];
+    uint8_t emphasis[3][240];
+    // triple buffering, the emulation thread draws into back, the presentation thread reads front
+    // and the newest finished frame waits in ready, so neither side ever waits for the other
+    // only swapBuffer() and acquire() touch ready, the FRESH bit says front has not taken it yet
+    static constexpr int FRESH = 0x04;
+    int back;
+    std::atomic<int> ready;
+    int front;
+    uint64_t sequence[3]; // frame number of each buffer
+    uint64_t published; // frames finished so far, producer side
 public:
     Frame();
-    void setColor(int x, int y, unsigned char r, unsigned char g, unsigned char b);
-    void swapBuffer();
-    unsigned char *getRawImage();
+    void setPixel(int y, int x, uint8_t colour);
+    uint8_t *line(int y); // scanline y of the frame being drawn
+    void setEmphasis(int y, uint8_t bits);
+    void swapBuffer(); // producer: publish the frame just drawn
+    // consumer side, one presentation thread only
+    bool acquire(); // take the newest finished frame, false if there is none since the last call
+    uint64_t frameNumber(); // sequence number of the acquired frame, starts at 1
+    const uint8_t *getIndices(); // acquired frame, 256x240
+    const uint8_t *getEmphasis(); // one entry per scanline of it
+    // turn the acquired frame into out, colours[emphasis][index] is the RGB palette
+    void convert(unsigned char *out, Format format, const uint8_t (*colours)[64][3]);
+    static int bytesPerPixel(Format format);
 };
 
+inline void Frame::setPixel(int y, int x, uint8_t colour)
+{
+    pixels[back][y][x] = colour;
+}
+
+inline uint8_t *Frame::line(int y)
+{
+    return pixels[back][y];
+}
+
+inline void Frame::setEmphasis(int y, uint8_t bits)
+{
+    emphasis[back][y] = bits;
+}
+
 #endif // FRAME_H
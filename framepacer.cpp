@@ -0,0 +1,81 @@
+#include "framepacer.h"
+#include "scheduler.h"
+
+#include <algorithm>
+#include <thread>
+
+// further behind than this and we give up catching up (breakpoint, window drag, slow machine)
+static constexpr double RESYNC_US = 100000.0;
+
+FramePacer::FramePacer()
+{
+    reset();
+}
+
+void FramePacer::reset()
+{
+    start = Clock::now();
+    ticks = 0;
+    sleepOvershoot = 1000.0; // refined after the first few sleeps
+    driftSum = driftMax = 0.0;
+    frameCount = 0;
+    resyncCount = 0;
+}
+
+void FramePacer::wait(uint64_t ticks)
+{
+    using namespace std::chrono;
+    this->ticks += ticks;
+    Clock::time_point deadline = start + duration_cast<Clock::duration>(duration<double>(this->ticks / Scheduler::MASTER_CLOCK));
+    Clock::time_point now = Clock::now();
+    if (duration<double, std::micro>(now - deadline).count() > RESYNC_US)
+    {
+        start = now;
+        this->ticks = 0;
+        resyncCount++;
+        return;
+    }
+    // hybrid wait: sleep while the deadline is further away than a sleep tends to overshoot,
+    // then spin for the rest, sleep_for alone is 50us late on Linux and up to 15ms on Windows
+    double remaining = duration<double, std::micro>(deadline - now).count();
+    if (remaining > sleepOvershoot)
+    {
+        double asked = remaining - sleepOvershoot;
+        std::this_thread::sleep_for(duration<double, std::micro>(asked));
+        Clock::time_point woke = Clock::now();
+        double slept = duration<double, std::micro>(woke - now).count();
+        // follow the overshoot quickly when it grows, slowly when it shrinks
+        double overshoot = std::max(slept - asked, 0.0) + 200.0;
+        sleepOvershoot = (overshoot > sleepOvershoot ? overshoot : sleepOvershoot * 0.95 + overshoot * 0.05);
+        now = woke;
+    }
+    while (now < deadline)
+    {
+        std::this_thread::yield();
+        now = Clock::now();
+    }
+    double drift = duration<double, std::micro>(now - deadline).count();
+    driftSum += drift;
+    driftMax = std::max(driftMax, drift);
+    frameCount++;
+}
+
+double FramePacer::averageDrift()
+{
+    return frameCount ? driftSum / frameCount : 0.0;
+}
+
+double FramePacer::maxDrift()
+{
+    return driftMax;
+}
+
+uint64_t FramePacer::frames()
+{
+    return frameCount;
+}
+
+uint64_t FramePacer::resyncs()
+{
+    return resyncCount;
+}
@@ -0,0 +1,35 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <chrono>
+#include <cstdint>
+
+class FramePacer // keeps the emulation at the speed of a real NES
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+public:
+    FramePacer();
+    void reset(); // start pacing from now, e.g. after a pause
+    // ticks is what the frame just emulated took in master clocks
+    // waits until that much wall time has passed since the previous deadline
+    void wait(uint64_t ticks);
+
+    // drift statistics since reset(), how late wait() came back after its deadline
+    double averageDrift(); // microseconds
+    double maxDrift();
+    uint64_t frames(); // paced since reset()
+    uint64_t resyncs(); // times the emulation fell too far behind and the deadline was moved
+
+private:
+    Clock::time_point start; // wall time of master tick 0
+    uint64_t ticks; // master ticks since start
+    double sleepOvershoot; // how much longer than asked sleep_for takes, in microseconds
+    double driftSum;
+    double driftMax;
+    uint64_t frameCount;
+    uint64_t resyncCount;
+};
+
+#endif // FRAMEPACER_H
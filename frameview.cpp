@@ -0,0 +1,85 @@
+#include "frameview.h"
+
+#include <QPainter>
+#include <algorithm>
+#include <cstring>
+
+FrameView::FrameView(QWidget *parent) :
+    QWidget(parent)
+{
+    memset(buffer, 0, sizeof(buffer));
+    ntscShown = false;
+    shown = nullptr;
+    lineRepeat = 1;
+    setAttribute(Qt::WA_OpaquePaintEvent); // paintEvent covers every pixel
+    setMinimumSize(256 * 2, 240 * 2);
+}
+
+unsigned char *FrameView::pixels()
+{
+    return (unsigned char *)buffer;
+}
+
+int FrameView::fitScale()
+{
+    // the scaler caps it, anything bigger is left as border
+    return std::clamp(std::min(width() / 256, height() / 240), 1, (int)Scaler::MAX_SCALE);
+}
+
+void FrameView::show(const uint32_t *data, int width, int height, int repeat)
+{
+    if (data != shown || image.width() != width || image.height() != height)
+    {
+        shown = data;
+        image = QImage((const uchar *)shown, width, height, width * 4, QImage::Format_RGBX8888);
+    }
+    lineRepeat = repeat;
+    update();
+}
+
+void FrameView::present()
+{
+    int scale = fitScale();
+    scaler.setScale(scale);
+    const uint32_t *out = scaler.process(buffer, 256, 240);
+    ntscShown = false;
+    show(out, 256 * scale, 240 * scale, 1);
+}
+
+void FrameView::presentNtsc(const uint8_t *indices, const uint8_t *emphasis)
+{
+    int scale = fitScale();
+    ntsc.setResolution(scale);
+    ntscBuffer.resize(ntsc.outputWidth() * 240);
+    ntsc.process(indices, emphasis, ntscBuffer.data());
+    ntscShown = true;
+    show(ntscBuffer.data(), ntsc.outputWidth(), 240, scale);
+}
+
+void FrameView::setFilter(Scaler::Filter filter)
+{
+    scaler.setFilter(filter);
+    if (!ntscShown)
+        present();
+}
+
+void FrameView::paintEvent(QPaintEvent *event)
+{
+    Q_UNUSED(event);
+    QPainter painter(this);
+    painter.fillRect(rect(), Qt::black);
+    if (image.isNull())
+        return;
+    QRect target(0, 0, image.width(), image.height() * lineRepeat);
+    target.moveCenter(rect().center());
+    painter.drawImage(target, image); // no smoothing, lines are just repeated
+}
+
+void FrameView::resizeEvent(QResizeEvent *event)
+{
+    QWidget::resizeEvent(event);
+    if (ntscShown)
+        update(); // the next frame comes at the new size
+    else
+        present();
+}
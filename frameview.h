@@ -0,0 +1,38 @@
+#ifndef FRAMEVIEW_H
+#define FRAMEVIEW_H
+
+#include <QWidget>
+#include <QImage>
+#include <vector>
+#include "scaler.h"
+#include "ntscfilter.h"
+
+class FrameView : public QWidget // draws the emulator output, only touched from the gui thread
+{
+    Q_OBJECT
+
+public:
+    explicit FrameView(QWidget *parent = nullptr);
+    unsigned char *pixels(); // 256x240 RGBA8888, convert a frame into it and call present()
+    void present(); // scale the frame in pixels() and schedule a repaint
+    void presentNtsc(const uint8_t *indices, const uint8_t *emphasis); // run a ppu frame through the NTSC filter instead
+    void setFilter(Scaler::Filter filter);
+
+protected:
+    void paintEvent(QPaintEvent *event) override;
+    void resizeEvent(QResizeEvent *event) override;
+
+private:
+    uint32_t buffer[240 * 256];
+    Scaler scaler;
+    NtscFilter ntsc;
+    std::vector<uint32_t> ntscBuffer;
+    bool ntscShown;
+    const uint32_t *shown; // scaler or ntsc output, reused from frame to frame
+    int lineRepeat; // the NTSC filter only widens, lines are repeated when drawing
+    QImage image; // wraps shown, only rebuilt when it moves or changes size
+    int fitScale(); // largest integer scale that fits the widget
+    void show(const uint32_t *data, int width, int height, int repeat);
+};
+
+#endif // FRAMEVIEW_H
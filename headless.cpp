@@ -0,0 +1,213 @@
+#include "nescore.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// runs a rom without any window, as fast as it goes, for benchmarks and regression runs
+//
+// input file: one "<frame> <buttons>" per line, buttons is a hex mask in controller order
+// (bit 0 A, B, Select, Start, Up, Down, Left, bit 7 Right), held until the next line,
+// a second mask after it is for controller 2, '#' starts a comment
+
+static void usage()
+{
+    std::cerr << "usage: nes_headless <rom> [options]\n"
+                 "  --frames N        run N frames (default 600)\n"
+                 "  --cycles N        run N cpu cycles instead\n"
+                 "  --input FILE      controller input, see headless.cpp\n"
+                 "  --palette FILE    .pal file used for --dump-frame\n"
+                 "  --dump-frame FILE write the last frame as binary PPM\n"
+                 "  --dump-ram FILE   write the 2KB of cpu RAM\n"
+                 "  --dot             use the dot renderer for every scanline\n"
+                 "  --skip            don't draw any frame but the last one\n";
+}
+
+struct InputEvent
+{
+    uint64_t frame;
+    uint8_t buttons[2];
+};
+
+static bool loadInput(const std::string &path, std::vector<InputEvent> &events)
+{
+    std::ifstream file(path);
+    if (!file)
+        return false;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        InputEvent event;
+        unsigned int buttons1 = 0, buttons2 = 0;
+        if (!(fields >> event.frame >> std::hex >> buttons1))
+            continue;
+        fields >> buttons2;
+        event.buttons[0] = buttons1;
+        event.buttons[1] = buttons2;
+        events.push_back(event);
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+    uint64_t frames = 600;
+    uint64_t cycles = 0; // 0: run frames
+    std::string inputPath, palettePath, framePath, ramPath;
+    bool dot = false;
+    bool skip = false;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--frames" && hasValue)
+            frames = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--cycles" && hasValue)
+            cycles = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--input" && hasValue)
+            inputPath = argv[++i];
+        else if (arg == "--palette" && hasValue)
+            palettePath = argv[++i];
+        else if (arg == "--dump-frame" && hasValue)
+            framePath = argv[++i];
+        else if (arg == "--dump-ram" && hasValue)
+            ramPath = argv[++i];
+        else if (arg == "--dot")
+            dot = true;
+        else if (arg == "--skip")
+            skip = true;
+        else
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    Cartridge *cartridge = new Cartridge();
+    try
+    {
+        cartridge->load(argv[1]);
+    }
+    catch (std::string e)
+    {
+        std::cerr << e << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<InputEvent> input;
+    if (!inputPath.empty() && !loadInput(inputPath, input))
+    {
+        std::cerr << "Cannot open input " << inputPath << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    MOS6502 *cpu = new MOS6502();
+    RICOH2C02 *ppu = new RICOH2C02();
+    Bus *bus = new Bus();
+    Scheduler *scheduler = new Scheduler();
+    // buttons pressed right now, the controllers ask for them by index through the callback
+    uint8_t buttons[2] = {0, 0};
+    std::map<KEY_MAP, int> mapping;
+    for (KEY_MAP key = KEY_A; key <= KEY_RIGHT; key = (KEY_MAP)(key + 1))
+        mapping[key] = key;
+    Controller *joypad1 = new Controller(mapping, [&](int key) -> bool { return buttons[0] & (1 << key); });
+    Controller *joypad2 = new Controller(mapping, [&](int key) -> bool { return buttons[1] & (1 << key); });
+
+    cpu->connectBus(bus);
+    ppu->connectBus(bus);
+    bus->connectAll(cpu, ppu, cartridge->mapper);
+    bus->connectJoypad1(joypad1);
+    bus->connectJoypad2(joypad2);
+    scheduler->connectAll(cpu, ppu, bus);
+    if (!palettePath.empty() && !ppu->initColourTable(palettePath))
+        return EXIT_FAILURE;
+    if (dot)
+        ppu->setRenderMode(RICOH2C02::RENDER_DOT);
+
+    cpu->reset();
+    ppu->reset();
+    scheduler->reset();
+
+    using namespace std::chrono;
+    const uint64_t frameTicks = 357366; // 29780.5 cpu cycles
+    uint64_t startTicks = scheduler->now();
+    uint64_t endTicks = startTicks + cycles * Scheduler::CPU_DIVIDER;
+    size_t nextInput = 0;
+    uint64_t frame = 0;
+    auto start = steady_clock::now();
+    while (cycles ? scheduler->now() < endTicks : frame < frames)
+    {
+        while (nextInput < input.size() && input[nextInput].frame <= frame)
+        {
+            buttons[0] = input[nextInput].buttons[0];
+            buttons[1] = input[nextInput].buttons[1];
+            nextInput++;
+        }
+        joypad1->poll();
+        joypad2->poll();
+        if (cycles && scheduler->now() + frameTicks > endTicks)
+        {
+            // stop right at the cycle count instead of the end of a frame
+            ppu->setSkipOutput(false);
+            scheduler->runUntil(endTicks);
+            break;
+        }
+        bool last = (cycles ? scheduler->now() + 2 * frameTicks > endTicks : frame + 1 == frames);
+        ppu->setSkipOutput(skip && !last);
+        scheduler->runFrame();
+        frame++;
+    }
+    double seconds = duration<double>(steady_clock::now() - start).count();
+
+    uint64_t cpuCycles = (scheduler->now() - startTicks) / Scheduler::CPU_DIVIDER;
+    uint64_t ppuFrames = ppu->frameCount;
+    printf("frames     %llu\n", (unsigned long long)ppuFrames);
+    printf("cpu cycles %llu\n", (unsigned long long)cpuCycles);
+    printf("time       %.3f s\n", seconds);
+    printf("fps        %.1f (%.2fx)\n", ppuFrames / seconds, ppuFrames / seconds / (Scheduler::MASTER_CLOCK / frameTicks));
+    printf("cycles/s   %.0f\n", cpuCycles / seconds);
+    printf("ms/frame   %.3f\n", ppuFrames ? seconds * 1000 / ppuFrames : 0.0);
+
+    if (!framePath.empty())
+    {
+        static unsigned char image[240 * 256 * 3];
+        if (!ppu->rendered(image, Frame::FORMAT_RGB888))
+            std::cerr << "No frame was finished, " << framePath << " is blank" << std::endl;
+        FILE *file = fopen(framePath.c_str(), "wb");
+        if (!file)
+        {
+            std::cerr << "Cannot write " << framePath << std::endl;
+            return EXIT_FAILURE;
+        }
+        fprintf(file, "P6\n256 240\n255\n");
+        fwrite(image, 1, sizeof(image), file);
+        fclose(file);
+    }
+    if (!ramPath.empty())
+    {
+        uint8_t ram[0x0800];
+        for (uint16_t addr = 0; addr < 0x0800; addr++)
+            ram[addr] = bus->cpuRead(addr, true);
+        FILE *file = fopen(ramPath.c_str(), "wb");
+        if (!file)
+        {
+            std::cerr << "Cannot write " << ramPath << std::endl;
+            return EXIT_FAILURE;
+        }
+        fwrite(ram, 1, sizeof(ram), file);
+        fclose(file);
+    }
+    return EXIT_SUCCESS;
+}
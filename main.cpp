@@ -1,9 +1,6 @@
-#include "controller.h"
+#include "nescore.h"
 #include "mainwindow.h"
 #include "debuggerwindow.h"
-#include "cartridge.h"
-#include "ricoh2c02.h"
-#include "mos6502.h"
 
 #include <QApplication>
 #include <QKeyEvent>
@@ -30,6 +27,7 @@ int main(int argc, char *argv[])
     MOS6502 *cpu = new MOS6502();
     RICOH2C02 *ppu = new RICOH2C02();
     Bus *bus = new Bus();
+    Scheduler *scheduler = new Scheduler();
     std::map<KEY_MAP, int> mapping1, mapping2;
     mapping1[KEY_A] = Qt::Key_J;
     mapping1[KEY_B] = Qt::Key_K;
@@ -55,14 +53,19 @@ int main(int argc, char *argv[])
     bus->connectAll(cpu, ppu, cartridge->mapper);
     bus->connectJoypad1(joypad1);
     bus->connectJoypad2(joypad2);
+    scheduler->connectAll(cpu, ppu, bus);
+
+    if (argc > 2) // optional .pal file in the 3rd argument
+        ppu->initColourTable(argv[2]);
 
     cpu->reset();
     ppu->reset();
+    scheduler->reset();
 
     QApplication a(argc, argv);
-    MainWindow w(nullptr, cpu, ppu, bus, joypad1, joypad2);
+    MainWindow w(nullptr, cpu, ppu, bus, scheduler, joypad1, joypad2);
     w.show();
-//    DebuggerWindow debugger(nullptr, bus, cpu, ppu);
+//    DebuggerWindow debugger(nullptr, bus, cpu, ppu, scheduler);
 //    debugger.show();
     return a.exec();
 }
@@ -1,9 +1,6 @@
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 
-#include <thread>
-#include <chrono>
-
 
 MainWindow::MainWindow(QWidget *parent) :
     QWidget(parent),
@@ -13,7 +10,7 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->setupUi(this);
 }
 
-MainWindow::MainWindow(QWidget *parent, MOS6502 *cpu, RICOH2C02 *ppu, Bus *bus, Controller *joypad1, Controller *joypad2) :
+MainWindow::MainWindow(QWidget *parent, MOS6502 *cpu, RICOH2C02 *ppu, Bus *bus, Scheduler *scheduler, Controller *joypad1, Controller *joypad2) :
     QWidget(parent),
     ui(new Ui::MainWindow)
 
@@ -25,6 +22,7 @@ MainWindow::MainWindow(QWidget *parent, MOS6502 *cpu, RICOH2C02 *ppu, Bus *bus,
     this->cpu = cpu;
     this->ppu = ppu;
     this->bus = bus;
+    this->scheduler = scheduler;
     this->joypad1 = joypad1;
     this->joypad2 = joypad2;
     if (this->joypad1)
@@ -41,43 +39,78 @@ MainWindow::MainWindow(QWidget *parent, MOS6502 *cpu, RICOH2C02 *ppu, Bus *bus,
             return this->keyPress(key);
         });
     }
-    using namespace std::chrono;
-    // two threads
-    // one for ticking, one for render
-    auto tick = std::thread([&]()
+    // frames are pushed to the gui thread instead of polled: the ppu calls back when one is finished,
+    // the queued signal carries it over, at most one in flight so a busy gui does not pile them up
+    framePending = false;
+    filter = Scaler::FILTER_NEAREST;
+    ntsc = false;
+    turbo = false;
+    frameSkip = 3;
+    resetPending = false;
+    connect(this, &MainWindow::frameReady, this, &MainWindow::presentFrame, Qt::QueuedConnection);
+    connect(this, &MainWindow::speedMeasured, this, &MainWindow::showSpeed, Qt::QueuedConnection);
+    this->ppu->setFrameCallback([this]()
     {
-        constexpr auto clockDelay = 559ns;
-        while (run)
-        {
-            this->cpu->clock();
-            if (joypad1)
-                this->joypad1->poll();
-            if (joypad2)
-                this->joypad2->poll();
-            this->ppu->clock3();
-            std::this_thread::sleep_for(clockDelay);
-        }
+        if (run && !framePending.exchange(true))
+            emit frameReady();
     });
-    auto render = std::thread([&]()
+    // the emulation runs on its own thread
+    emulation = std::thread([this]()
     {
-        constexpr auto renderDelay = 6ms;
-        const int scale = 2;
+        using namespace std::chrono;
+        bool paced = true;
+        int skipped = 0; // frames skipped in a row
+        uint64_t measuredTicks = 0;
+        auto measureStart = steady_clock::now();
+        pacer.reset();
         while (run)
         {
-            QImage image(this->ppu->rendered(), 256, 240, QImage::Format_RGB888);
-            image = image.scaled(256 * scale, 240 * scale);
-            QPixmap pixmap = QPixmap::fromImage(image);
-            ui->labelOutput->setPixmap(pixmap);
-            std::this_thread::sleep_for(renderDelay);
+            // never in the middle of runFrame(), the scheduler owns the cpu and ppu until it returns
+            if (resetPending.exchange(false))
+            {
+                this->cpu->reset();
+                this->ppu->reset();
+                this->scheduler->reset();
+            }
+            // one whole frame at a time as fast as possible, the scheduler interleaves cpu, ppu and interrupts
+            // then wait for the frame's deadline (357366 master ticks, 60.0988 Hz)
+            if (this->joypad1)
+                this->joypad1->poll();
+            if (this->joypad2)
+                this->joypad2->poll();
+            // turbo: no pacing, and only one of every frameSkip + 1 frames is drawn
+            bool fast = turbo;
+            if (!fast && !paced)
+                pacer.reset(); // don't count the turbo run as lateness
+            paced = !fast;
+            bool skip = (fast && skipped < frameSkip);
+            skipped = (skip ? skipped + 1 : 0);
+            this->ppu->setSkipOutput(skip);
+            uint64_t ticks = this->scheduler->runFrame();
+            if (!fast)
+                pacer.wait(ticks);
+            // emulated time over wall time, about once a second
+            measuredTicks += ticks;
+            double elapsed = duration<double>(steady_clock::now() - measureStart).count();
+            if (elapsed >= 1.0)
+            {
+                emit speedMeasured(measuredTicks / Scheduler::MASTER_CLOCK / elapsed, pacer.averageDrift(), pacer.maxDrift());
+                measuredTicks = 0;
+                measureStart = steady_clock::now();
+            }
         }
     });
-    tick.detach();
-    render.detach();
 }
 
 MainWindow::~MainWindow()
 {
     run = false;
+    // the emulation thread calls back into this window, let it finish its frame first
+    if (emulation.joinable())
+    {
+        emulation.join();
+        ppu->setFrameCallback(nullptr);
+    }
     delete ui;
 }
 
@@ -89,6 +122,17 @@ bool MainWindow::keyPress(int key)
 void MainWindow::keyPressEvent(QKeyEvent *event)
 {
     keyStatus[(Qt::Key)event->key()] = true;
+    if (event->key() == Qt::Key_F2 && !event->isAutoRepeat()) // cycle the output filter
+    {
+        filter = (Scaler::Filter)((filter + 1) % Scaler::FILTER_COUNT);
+        ui->frameView->setFilter(filter);
+    }
+    if (event->key() == Qt::Key_F3 && !event->isAutoRepeat()) // NTSC filter on/off
+        ntsc = !ntsc;
+    if (event->key() == Qt::Key_F4 && !event->isAutoRepeat()) // turbo on/off
+        turbo = !turbo;
+    if (event->key() == Qt::Key_F5 && !event->isAutoRepeat()) // frames skipped in turbo, 0-9
+        frameSkip = (frameSkip + 1) % 10;
 }
 
 void MainWindow::keyReleaseEvent(QKeyEvent *event)
@@ -96,8 +140,31 @@ void MainWindow::keyReleaseEvent(QKeyEvent *event)
     keyStatus[(Qt::Key)event->key()] = false;
 }
 
+void MainWindow::presentFrame()
+{
+    framePending = false;
+    if (ntsc)
+    {
+        // the filter works on the colour indices and emphasis bits themselves
+        if (ppu->frame.acquire())
+            ui->frameView->presentNtsc(ppu->frame.getIndices(), ppu->frame.getEmphasis());
+    }
+    // the ppu only leaves colour indices behind, turn them into RGB here
+    else if (ppu->rendered(ui->frameView->pixels(), Frame::FORMAT_RGBA8888))
+        ui->frameView->present();
+}
+
+void MainWindow::showSpeed(double speed, double driftAverage, double driftMax)
+{
+    QString title = QString("NES_SIM - %1x").arg(speed, 0, 'f', 2);
+    if (turbo)
+        title += QString(" (turbo, skip %1)").arg(frameSkip.load());
+    else // how late the frame pacer wakes up, since it was last reset
+        title += QString(" (drift avg %1 µs, max %2 µs)").arg(driftAverage, 0, 'f', 0).arg(driftMax, 0, 'f', 0);
+    setWindowTitle(title);
+}
+
 void MainWindow::reset()
 {
-    cpu->reset();
-    ppu->reset();
+    resetPending = true; // picked up by the emulation thread
 }
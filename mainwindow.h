@@ -2,12 +2,17 @@
 #define MAINWINDOW_H
 
 #include <QWidget>
+#include <atomic>
 #include <map>
+#include <thread>
 #include <QKeyEvent>
 #include "mos6502.h"
 #include "ricoh2c02.h"
 #include "bus.h"
 #include "controller.h"
+#include "scheduler.h"
+#include "scaler.h"
+#include "framepacer.h"
 
 namespace Ui {
 class MainWindow;
@@ -19,26 +24,41 @@ class MainWindow : public QWidget
 
 public:
     explicit MainWindow(QWidget *parent = nullptr);
-    explicit MainWindow(QWidget *parent, MOS6502 *cpu, RICOH2C02 *ppu, Bus *bus, Controller *joypad1, Controller *joypad2);
+    explicit MainWindow(QWidget *parent, MOS6502 *cpu, RICOH2C02 *ppu, Bus *bus, Scheduler *scheduler, Controller *joypad1, Controller *joypad2);
     ~MainWindow();
 
 private:
     MOS6502 *cpu;
     RICOH2C02 *ppu;
     Bus *bus;
+    Scheduler *scheduler;
     Controller *joypad1;
     Controller *joypad2;
     std::map<Qt::Key, bool> keyStatus;
     bool keyPress(int key);
     Ui::MainWindow *ui;
-    bool run;
+    std::atomic_bool run; // cleared by the destructor, the emulation thread checks it between frames
+    std::thread emulation; // joined by the destructor
+    std::atomic_bool framePending; // frameReady emitted, presentFrame not run yet
+    Scaler::Filter filter; // F2 cycles through them
+    bool ntsc; // F3, replaces the scaler
+    FramePacer pacer; // emulation thread only
+    std::atomic_bool turbo; // F4, no pacing and frame skipping
+    std::atomic_int frameSkip; // F5, frames skipped for every one drawn in turbo
+    std::atomic_bool resetPending; // reset button clicked, the emulation thread resets between frames
 
 protected:
     void keyPressEvent(QKeyEvent *event) override;
     void keyReleaseEvent(QKeyEvent *event) override;
 
+signals:
+    void frameReady(); // emitted from the emulation thread
+    void speedMeasured(double speed, double driftAverage, double driftMax); // emulated seconds per wall second and pacing drift in microseconds, from the emulation thread
+
 private slots:
     void reset();
+    void presentFrame();
+    void showSpeed(double speed, double driftAverage, double driftMax);
 };
 
 #endif // MAINWINDOW_H
@@ -1,11 +1,171 @@
 #include "mapper.h"
+#include "bus.h"
+#include "global.h"
+
+#include <iostream>
+#include <iomanip>
 
 Mapper::Mapper()
 {
     this->cart = nullptr;
+    this->bus = nullptr;
+    std::fill(prgWindow, prgWindow + 4, nullptr);
+    std::fill(chrWindow, chrWindow + 8, nullptr);
+    std::fill(tileValid, tileValid + 512, false);
+    prgRamEnabled = false;
+    mirroring = MIRROR_HORIZONTAL;
 }
 
-Mapper::Mapper(Cartridge *cart)
+Mapper::Mapper(Cartridge *cart) : Mapper()
 {
     this->cart = cart;
+    prgRamEnabled = cart->prgRamSize != 0;
+    // fixed by the header unless the mapper controls it
+    if (cart->fourScreen)
+        mirroring = MIRROR_FOUR_SCREEN;
+    else
+        mirroring = (cart->mirrorMode ? MIRROR_VERTICAL : MIRROR_HORIZONTAL);
+}
+
+void Mapper::connectBus(Bus *bus)
+{
+    this->bus = bus;
+    updateMap();
+    updateNametables();
+}
+
+// bank numbers wrap around the actual ROM size, like the unconnected upper address lines do
+void Mapper::mapPRG8K(int slot, int bank)
+{
+    uint32_t count = cart->prgRomSize / 8_KB;
+    if (count)
+        prgWindow[slot] = cart->PRG_ROM + (bank % count) * 8_KB;
+}
+
+void Mapper::mapPRG16K(int slot, int bank)
+{
+    mapPRG8K(slot * 2, bank * 2);
+    mapPRG8K(slot * 2 + 1, bank * 2 + 1);
+}
+
+void Mapper::mapPRG32K(int bank)
+{
+    mapPRG16K(0, bank * 2);
+    mapPRG16K(1, bank * 2 + 1);
+}
+
+void Mapper::mapCHR1K(int slot, int bank)
+{
+    uint8_t *chr = cart->chrRomSize ? cart->CHR_ROM : cart->CHR_RAM;
+    uint32_t count = (cart->chrRomSize ? cart->chrRomSize : cart->chrRamSize) / 1_KB;
+    if (!count)
+        return;
+    uint8_t *window = chr + (bank % count) * 1_KB;
+    if (window == chrWindow[slot])
+        return;
+    chrWindow[slot] = window;
+    std::fill(tileValid + slot * 64, tileValid + (slot + 1) * 64, false); // 64 tiles per 1KB
+}
+
+void Mapper::mapCHR4K(int slot, int bank)
+{
+    for (int i = 0; i < 4; i++)
+        mapCHR1K(slot * 4 + i, bank * 4 + i);
+}
+
+void Mapper::mapCHR8K(int bank)
+{
+    mapCHR4K(0, bank * 2);
+    mapCHR4K(1, bank * 2 + 1);
+}
+
+void Mapper::updateMap()
+{
+    if (!bus)
+        return;
+    if (prgRamEnabled)
+        bus->mapCpu(0x6000, 8_KB, cart->PRG_RAM, true);
+    else
+        bus->unmapCpu(0x6000, 8_KB);
+    for (int i = 0; i < 4; i++)
+    {
+        if (prgWindow[i])
+            bus->mapCpu(0x8000 + i * 8_KB, 8_KB, prgWindow[i], false);
+    }
+}
+
+void Mapper::setMirroring(Mirroring mode)
+{
+    if (cart->fourScreen) // the cartridge has its own VRAM and ignores the mirroring control
+        mode = MIRROR_FOUR_SCREEN;
+    if (mode == mirroring)
+        return;
+    mirroring = mode;
+    updateNametables();
+}
+
+void Mapper::updateNametables()
+{
+    if (!bus)
+        return;
+    // 1KB pages behind $2000, $2400, $2800 and $2C00, pages 2 and 3 are the cartridge VRAM
+    static const int pages[5][4] = {
+        {0, 0, 1, 1}, // horizontal
+        {0, 1, 0, 1}, // vertical
+        {0, 0, 0, 0}, // single lower
+        {1, 1, 1, 1}, // single upper
+        {0, 1, 2, 3}  // four-screen
+    };
+    for (int slot = 0; slot < 4; slot++)
+        bus->mapNametable(slot, pages[mirroring][slot]);
+}
+
+uint8_t Mapper::cpuRead(uint16_t addr)
+{
+    if (0x6000 <= addr && addr <= 0x7FFF) // Battery-backed save or work RAM
+        return prgRamEnabled ? cart->PRG_RAM[addr - 0x6000] : 0;
+    else if (addr >= 0x8000)
+        return prgWindow[(addr >> 13) & 0x03][addr & 0x1FFF];
+    return 0;
+}
+
+void Mapper::ppuWrite(uint16_t addr, uint8_t value)
+{
+    if (cart->chrRomSize)
+        std::cerr << "Invalid PPU write to CHR-ROM " << "addr=" << std::hex << std::setw(4) << std::setfill('0') << addr << std::endl;
+    else if (addr <= 0x1FFF)
+    {
+        uint8_t *window = chrWindow[addr >> 10];
+        window[addr & 0x03FF] = value;
+        // the same bank can sit in several slots, drop the tile everywhere it is visible
+        for (int slot = 0; slot < 8; slot++)
+        {
+            if (chrWindow[slot] == window)
+                tileValid[(slot << 6) | ((addr >> 4) & 0x3F)] = false;
+        }
+    }
+    else
+        std::cerr << "ppuWrite out of bound in mapper " << "addr=" << std::hex << std::setw(4) << std::setfill('0') << addr << std::endl;
+}
+
+void Mapper::decodeTile(int tile)
+{
+    for (int row = 0; row < 8; row++)
+    {
+        uint16_t addr = ((tile << 4) | row);
+        uint8_t low = ppuRead(addr);
+        uint8_t high = ppuRead(addr + 8);
+        for (int x = 0; x < 8; x++)
+        {
+            uint8_t pixel = ((((high >> (7 - x)) & 0x01) << 1) | ((low >> (7 - x)) & 0x01));
+            tileCache[tile][row][0][x] = pixel;
+            tileCache[tile][row][1][7 - x] = pixel;
+        }
+    }
+    tileValid[tile] = true;
+}
+
+RICOH2C02::Kernel Mapper::ppuKernel()
+{
+    return &RICOH2C02::runWith<Mapper>; // generic, goes through virtual calls
 }
@@ -2,23 +2,77 @@
 #define MAPPER_H
 
 #include "cartridge.h"
+#include "ricoh2c02.h"
 #include <cstdint>
 
 class Cartridge;
+class Bus;
 
 class Mapper
 {
+public:
+    // https://www.nesdev.org/wiki/Mirroring#Nametable_Mirroring
+    enum Mirroring
+    {
+        MIRROR_HORIZONTAL,
+        MIRROR_VERTICAL,
+        MIRROR_SINGLE_LOWER, // one-screen, first 1KB of CIRAM
+        MIRROR_SINGLE_UPPER, // one-screen, second 1KB of CIRAM
+        MIRROR_FOUR_SCREEN   // 2KB of extra VRAM on the cartridge
+    };
+
 protected:
     Cartridge *cart;
+    Bus *bus;
+protected:
+    // bank windows pointing into the cartridge arena
+    // only recalculated when a bank register is committed
+    uint8_t *prgWindow[4]; // 8KB each, CPU $8000-$FFFF
+    uint8_t *chrWindow[8]; // 1KB each, PPU $0000-$1FFF
+    bool prgRamEnabled;
+    // CHR decoded into 2-bit pixel indices, filled on first use
+    // dropped by CHR-RAM writes and when a 1KB window points elsewhere
+    uint8_t tileCache[512][8][2][8]; // [tile][row][plain, horizontally flipped][pixel]
+    bool tileValid[512];
+    void decodeTile(int tile);
+    void mapPRG8K(int slot, int bank);
+    void mapPRG16K(int slot, int bank); // slot 0: $8000, slot 1: $C000
+    void mapPRG32K(int bank);
+    void mapCHR1K(int slot, int bank);
+    void mapCHR4K(int slot, int bank); // slot 0: $0000, slot 1: $1000
+    void mapCHR8K(int bank);
+    void updateMap(); // publish PRG-RAM and the PRG windows to the cpu page table
+    // nametable layout, published to the bus only when it changes
+    Mirroring mirroring;
+    void setMirroring(Mirroring mode);
+    void updateNametables(); // publish the nametable slots to the bus
 public:
     Mapper();
     Mapper(Cartridge *cart);
+    virtual ~Mapper() = default;
+    void connectBus(Bus *bus); // also publishes the current banks to the bus
     virtual void init() = 0;
-    virtual uint8_t cpuRead(uint16_t addr) = 0;
+    virtual uint8_t cpuRead(uint16_t addr); // only for addresses that are not in the cpu page table
     virtual void cpuWrite(uint16_t addr, uint8_t value) = 0;
-    virtual uint8_t ppuRead(uint16_t addr) = 0;
-    virtual void ppuWrite(uint16_t addr, uint8_t value) = 0;
-    virtual uint16_t mirrored(uint16_t addr) = 0; // evaluate mirrored address
+    virtual uint8_t ppuRead(uint16_t addr);
+    virtual void ppuWrite(uint16_t addr, uint8_t value);
+    const uint8_t *tileRow(uint16_t addr, bool flip); // 8 pixels, leftmost first, addr is the low plane byte ((addr & 0x08) == 0)
+    virtual RICOH2C02::Kernel ppuKernel(); // ppu rendering loop instantiated for this mapper
 };
 
+// called by the ppu several times per tile, inline so that
+// RICOH2C02::runWith<M> does not need a virtual call for final mappers
+inline uint8_t Mapper::ppuRead(uint16_t addr) // bus only forwards $0000-$1FFF
+{
+    return chrWindow[addr >> 10][addr & 0x03FF];
+}
+
+inline const uint8_t *Mapper::tileRow(uint16_t addr, bool flip)
+{
+    int tile = (addr >> 4) & 0x01FF;
+    if (!tileValid[tile])
+        decodeTile(tile);
+    return tileCache[tile][addr & 0x07][flip];
+}
+
 #endif // MAPPER_H
@@ -1,4 +1,6 @@
 #include "mapper001.h"
+#include "bus.h"
+#include "global.h"
 
 #include <iostream>
 #include <iomanip>
@@ -11,42 +13,69 @@ void Mapper001::init()
     chrBank0 = 0;
     chrBank1 = 0;
     pgrBank = 0x00;
+    updateBanks();
 }
 
-uint8_t Mapper001::cpuRead(uint16_t addr)
+/* PRG bank
+4bit0
+-----
+RPPPP
+|||||
+|++++- Select 16 KB PRG ROM bank (low bit ignored in 32 KB mode)
++----- MMC1B and later: PRG RAM chip enable (0: enabled; 1: disabled; ignored on MMC1A)
+*/
+void Mapper001::updateBanks()
 {
     int P = pgrBank & 0x0F;
     int R = (pgrBank >> 4) & 0x01;
-    uint8_t ret;
-    if (0x6000 <= addr && addr <= 0x7FFF) // Battery-backed save or work RAM
+    prgRamEnabled = cart->prgRamSize && !R;
+    switch ((control >> 2) & 0x03)
     {
-        ret = (!R ? cart->PRG_RAM[addr - 0x6000] : 0);
+    case 0:
+    case 1: // switch 32 KB at $8000, ignoring low bit of bank number
+        mapPRG32K(P >> 1);
+        break;
+    case 2: // fix first bank at $8000 and switch 16 KB bank at $C000
+        mapPRG16K(0, 0);
+        mapPRG16K(1, P);
+        break;
+    case 3: // fix last bank at $C000 and switch 16 KB bank at $8000
+        mapPRG16K(0, P);
+        mapPRG16K(1, cart->prgRomSize / 16_KB - 1);
+        break;
+    default:
+        break;
     }
-    else
+    if ((control >> 4) & 0x01) // switch two separate 4 KB banks
     {
-        switch ((control >> 2) & 0x03)
-        {
-        case 0:
-        case 1:
-            ret = cart->PRG_ROM[P][addr & 0x3FFF];
-            break;
-        case 2:
-            ret = cart->PRG_ROM[addr < 0xC000 ? 0 : P][addr & 0x3FFF];
-            break;
-        case 3:
-            ret = cart->PRG_ROM[addr < 0xC000 ? P : cart->nPRG_ROM - 1][addr & 0x3FFF];
-            break;
-        default:
-            break;
-        }
+        mapCHR4K(0, chrBank0);
+        mapCHR4K(1, chrBank1);
+    }
+    else // switch 8 KB at a time, low bit ignored
+        mapCHR8K(chrBank0 >> 1);
+    updateMap();
+    switch (control & 0x03)
+    {
+    case 0:
+        setMirroring(MIRROR_SINGLE_LOWER);
+        break;
+    case 1:
+        setMirroring(MIRROR_SINGLE_UPPER);
+        break;
+    case 2:
+        setMirroring(MIRROR_VERTICAL);
+        break;
+    case 3:
+        setMirroring(MIRROR_HORIZONTAL);
+        break;
+    default:
+        break;
     }
-    return ret;
 }
 
 void Mapper001::cpuWrite(uint16_t addr, uint8_t value)
 {
-    int R = (pgrBank >> 4) & 0x01;
-    if (0x6000 <= addr && addr <= 0x7FFF && !R) // Battery-backed save or work RAM
+    if (0x6000 <= addr && addr <= 0x7FFF && prgRamEnabled) // Battery-backed save or work RAM
     {
         cart->PRG_RAM[addr - 0x6000] = value;
     }
@@ -84,61 +113,12 @@ void Mapper001::cpuWrite(uint16_t addr, uint8_t value)
                 break;
             }
             shift = 0;
+            updateBanks();
         }
     }
 }
 
-uint8_t Mapper001::ppuRead(uint16_t addr)
-{
-    if (addr <= 0x1FFF) // maximum 8KB of CHR memory
-    {
-//        int C = (control >> 4) & 0x01;
-        int upperBank = addr >= 0x1000;
-        return cart->nCHR_ROM ?
-               cart->CHR_ROM[upperBank ? (chrBank1 >> 1) : (chrBank0 >> 1)][addr] :
-               cart->CHR_RAM[upperBank ? (chrBank1 >> 1) : (chrBank0 >> 1)][addr];
-    }
-    else
-    {
-        std::cerr << "ppuWrite out of bound in mapper " << "addr=" << std::hex << std::setw(4) << std::setfill('0') << addr << std::endl;
-        return 0;
-    }
-}
-
-void Mapper001::ppuWrite(uint16_t addr, uint8_t value)
+RICOH2C02::Kernel Mapper001::ppuKernel()
 {
-    if (cart->nCHR_ROM)
-        std::cerr << "Invalid PPU write to CHR-ROM " << "addr=" << std::hex << std::setw(4) << std::setfill('0') << addr << std::endl;
-    else if (addr <= 0x1FFF) // maximum 8KB of CHR memory
-    {
-//        int C = (control >> 4) & 0x01;
-        int upperBank = addr >= 0x1000;
-        cart->CHR_RAM[upperBank ? (chrBank1 >> 1) : (chrBank0 >> 1)][addr] = value;
-    }
-    else
-        std::cerr << "ppuWrite out of bound in mapper " << "addr=" << std::hex << std::setw(4) << std::setfill('0') << addr << std::endl;
+    return &RICOH2C02::runWith<Mapper001>;
 }
-
-uint16_t Mapper001::mirrored(uint16_t addr)
-{
-    int mirrorMode = control & 0x03;
-    switch (mirrorMode)
-    {
-    case 0:
-        addr &= 0x03FF;
-        break;
-    case 1:
-        addr = (addr & 0x03FF) | 0x0400;
-        break;
-    case 2:
-        addr &= ~0xF800;
-        break;
-    case 3:
-        addr &= ~0xF400;
-        break;
-    default:
-        break;
-    }
-    return addr;
-}
-
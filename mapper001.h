@@ -3,17 +3,14 @@
 
 #include "mapper.h"
 
-class Mapper001 : public Mapper // actually MMC1B
+class Mapper001 final : public Mapper // actually MMC1B
 {
 public:
     using Mapper::Mapper;
 
     virtual void init();
-    virtual uint8_t cpuRead(uint16_t addr);
     virtual void cpuWrite(uint16_t addr, uint8_t value);
-    virtual uint8_t ppuRead(uint16_t addr);
-    virtual void ppuWrite(uint16_t addr, uint8_t value);
-    virtual uint16_t mirrored(uint16_t addr); // evaluate mirrored address in nametable
+    virtual RICOH2C02::Kernel ppuKernel();
 
 private: // internal regs
     int writeCount;
@@ -22,6 +19,7 @@ private: // internal regs
     uint8_t chrBank0;
     uint8_t chrBank1;
     uint8_t pgrBank;
+    void updateBanks(); // recalculate bank windows after a register is committed
 };
 
 #endif // MAPPER001_H
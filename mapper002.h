@@ -4,20 +4,18 @@
 
 #include "mapper.h"
 
-class Mapper002 : public Mapper
+class Mapper002 final : public Mapper
 {
 public:
     using Mapper::Mapper;
 
     virtual void init();
-    virtual uint8_t cpuRead(uint16_t addr);
     virtual void cpuWrite(uint16_t addr, uint8_t value);
-    virtual uint8_t ppuRead(uint16_t addr);
-    virtual void ppuWrite(uint16_t addr, uint8_t value);
-    virtual uint16_t mirrored(uint16_t addr); // evaluate mirrored address in nametable
+    virtual RICOH2C02::Kernel ppuKernel();
 
 private:
     uint8_t pgrBank;
+    void updateBanks(); // recalculate bank windows after pgrBank changed
 };
 
 #endif // MAPPER002_H
@@ -20,6 +20,67 @@ inline static uint16_t u8tou16(uint8_t x)
     return static_cast<uint16_t>(x);
 }
 
+// instruction set
+// table taken from OneLoneCoder
+// I add the accumulator addressing mode
+// suppose XXX has total cycles of 2
+using Op = MOS6502::Op;
+using Mode = MOS6502::Mode;
+static constexpr MOS6502::Instruction lookup[256] = {
+    { Op::BRK, Mode::IMM, 7 },{ Op::ORA, Mode::IZX, 6 },{ Op::XXX, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 8 },{ Op::NOP, Mode::IMP, 3 },{ Op::ORA, Mode::ZP0, 3 },{ Op::ASL, Mode::ZP0, 5 },{ Op::XXX, Mode::IMP, 5 },{ Op::PHP, Mode::IMP, 3 },{ Op::ORA, Mode::IMM, 2 },{ Op::ASL, Mode::ACC, 2 },{ Op::XXX, Mode::IMP, 2 },{ Op::NOP, Mode::IMP, 4 },{ Op::ORA, Mode::ABS, 4 },{ Op::ASL, Mode::ABS, 6 },{ Op::XXX, Mode::IMP, 6 },
+    { Op::BPL, Mode::REL, 2 },{ Op::ORA, Mode::IZY, 5 },{ Op::XXX, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 8 },{ Op::NOP, Mode::IMP, 4 },{ Op::ORA, Mode::ZPX, 4 },{ Op::ASL, Mode::ZPX, 6 },{ Op::XXX, Mode::IMP, 6 },{ Op::CLC, Mode::IMP, 2 },{ Op::ORA, Mode::ABY, 4 },{ Op::NOP, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 7 },{ Op::NOP, Mode::IMP, 4 },{ Op::ORA, Mode::ABX, 4 },{ Op::ASL, Mode::ABX, 7 },{ Op::XXX, Mode::IMP, 7 },
+    { Op::JSR, Mode::ABS, 6 },{ Op::AND, Mode::IZX, 6 },{ Op::XXX, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 8 },{ Op::BIT, Mode::ZP0, 3 },{ Op::AND, Mode::ZP0, 3 },{ Op::ROL, Mode::ZP0, 5 },{ Op::XXX, Mode::IMP, 5 },{ Op::PLP, Mode::IMP, 4 },{ Op::AND, Mode::IMM, 2 },{ Op::ROL, Mode::ACC, 2 },{ Op::XXX, Mode::IMP, 2 },{ Op::BIT, Mode::ABS, 4 },{ Op::AND, Mode::ABS, 4 },{ Op::ROL, Mode::ABS, 6 },{ Op::XXX, Mode::IMP, 6 },
+    { Op::BMI, Mode::REL, 2 },{ Op::AND, Mode::IZY, 5 },{ Op::XXX, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 8 },{ Op::NOP, Mode::IMP, 4 },{ Op::AND, Mode::ZPX, 4 },{ Op::ROL, Mode::ZPX, 6 },{ Op::XXX, Mode::IMP, 6 },{ Op::SEC, Mode::IMP, 2 },{ Op::AND, Mode::ABY, 4 },{ Op::NOP, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 7 },{ Op::NOP, Mode::IMP, 4 },{ Op::AND, Mode::ABX, 4 },{ Op::ROL, Mode::ABX, 7 },{ Op::XXX, Mode::IMP, 7 },
+    { Op::RTI, Mode::IMP, 6 },{ Op::EOR, Mode::IZX, 6 },{ Op::XXX, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 8 },{ Op::NOP, Mode::IMP, 3 },{ Op::EOR, Mode::ZP0, 3 },{ Op::LSR, Mode::ZP0, 5 },{ Op::XXX, Mode::IMP, 5 },{ Op::PHA, Mode::IMP, 3 },{ Op::EOR, Mode::IMM, 2 },{ Op::LSR, Mode::ACC, 2 },{ Op::XXX, Mode::IMP, 2 },{ Op::JMP, Mode::ABS, 3 },{ Op::EOR, Mode::ABS, 4 },{ Op::LSR, Mode::ABS, 6 },{ Op::XXX, Mode::IMP, 6 },
+    { Op::BVC, Mode::REL, 2 },{ Op::EOR, Mode::IZY, 5 },{ Op::XXX, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 8 },{ Op::NOP, Mode::IMP, 4 },{ Op::EOR, Mode::ZPX, 4 },{ Op::LSR, Mode::ZPX, 6 },{ Op::XXX, Mode::IMP, 6 },{ Op::CLI, Mode::IMP, 2 },{ Op::EOR, Mode::ABY, 4 },{ Op::NOP, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 7 },{ Op::NOP, Mode::IMP, 4 },{ Op::EOR, Mode::ABX, 4 },{ Op::LSR, Mode::ABX, 7 },{ Op::XXX, Mode::IMP, 7 },
+    { Op::RTS, Mode::IMP, 6 },{ Op::ADC, Mode::IZX, 6 },{ Op::XXX, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 8 },{ Op::NOP, Mode::IMP, 3 },{ Op::ADC, Mode::ZP0, 3 },{ Op::ROR, Mode::ZP0, 5 },{ Op::XXX, Mode::IMP, 5 },{ Op::PLA, Mode::IMP, 4 },{ Op::ADC, Mode::IMM, 2 },{ Op::ROR, Mode::ACC, 2 },{ Op::XXX, Mode::IMP, 2 },{ Op::JMP, Mode::IND, 5 },{ Op::ADC, Mode::ABS, 4 },{ Op::ROR, Mode::ABS, 6 },{ Op::XXX, Mode::IMP, 6 },
+    { Op::BVS, Mode::REL, 2 },{ Op::ADC, Mode::IZY, 5 },{ Op::XXX, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 8 },{ Op::NOP, Mode::IMP, 4 },{ Op::ADC, Mode::ZPX, 4 },{ Op::ROR, Mode::ZPX, 6 },{ Op::XXX, Mode::IMP, 6 },{ Op::SEI, Mode::IMP, 2 },{ Op::ADC, Mode::ABY, 4 },{ Op::NOP, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 7 },{ Op::NOP, Mode::IMP, 4 },{ Op::ADC, Mode::ABX, 4 },{ Op::ROR, Mode::ABX, 7 },{ Op::XXX, Mode::IMP, 7 },
+    { Op::NOP, Mode::IMP, 2 },{ Op::STA, Mode::IZX, 6 },{ Op::NOP, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 6 },{ Op::STY, Mode::ZP0, 3 },{ Op::STA, Mode::ZP0, 3 },{ Op::STX, Mode::ZP0, 3 },{ Op::XXX, Mode::IMP, 3 },{ Op::DEY, Mode::IMP, 2 },{ Op::NOP, Mode::IMP, 2 },{ Op::TXA, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 2 },{ Op::STY, Mode::ABS, 4 },{ Op::STA, Mode::ABS, 4 },{ Op::STX, Mode::ABS, 4 },{ Op::XXX, Mode::IMP, 4 },
+    { Op::BCC, Mode::REL, 2 },{ Op::STA, Mode::IZY, 6 },{ Op::XXX, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 6 },{ Op::STY, Mode::ZPX, 4 },{ Op::STA, Mode::ZPX, 4 },{ Op::STX, Mode::ZPY, 4 },{ Op::XXX, Mode::IMP, 4 },{ Op::TYA, Mode::IMP, 2 },{ Op::STA, Mode::ABY, 5 },{ Op::TXS, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 5 },{ Op::NOP, Mode::IMP, 5 },{ Op::STA, Mode::ABX, 5 },{ Op::XXX, Mode::IMP, 5 },{ Op::XXX, Mode::IMP, 5 },
+    { Op::LDY, Mode::IMM, 2 },{ Op::LDA, Mode::IZX, 6 },{ Op::LDX, Mode::IMM, 2 },{ Op::XXX, Mode::IMP, 6 },{ Op::LDY, Mode::ZP0, 3 },{ Op::LDA, Mode::ZP0, 3 },{ Op::LDX, Mode::ZP0, 3 },{ Op::XXX, Mode::IMP, 3 },{ Op::TAY, Mode::IMP, 2 },{ Op::LDA, Mode::IMM, 2 },{ Op::TAX, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 2 },{ Op::LDY, Mode::ABS, 4 },{ Op::LDA, Mode::ABS, 4 },{ Op::LDX, Mode::ABS, 4 },{ Op::XXX, Mode::IMP, 4 },
+    { Op::BCS, Mode::REL, 2 },{ Op::LDA, Mode::IZY, 5 },{ Op::XXX, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 5 },{ Op::LDY, Mode::ZPX, 4 },{ Op::LDA, Mode::ZPX, 4 },{ Op::LDX, Mode::ZPY, 4 },{ Op::XXX, Mode::IMP, 4 },{ Op::CLV, Mode::IMP, 2 },{ Op::LDA, Mode::ABY, 4 },{ Op::TSX, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 4 },{ Op::LDY, Mode::ABX, 4 },{ Op::LDA, Mode::ABX, 4 },{ Op::LDX, Mode::ABY, 4 },{ Op::XXX, Mode::IMP, 4 },
+    { Op::CPY, Mode::IMM, 2 },{ Op::CMP, Mode::IZX, 6 },{ Op::NOP, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 8 },{ Op::CPY, Mode::ZP0, 3 },{ Op::CMP, Mode::ZP0, 3 },{ Op::DEC, Mode::ZP0, 5 },{ Op::XXX, Mode::IMP, 5 },{ Op::INY, Mode::IMP, 2 },{ Op::CMP, Mode::IMM, 2 },{ Op::DEX, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 2 },{ Op::CPY, Mode::ABS, 4 },{ Op::CMP, Mode::ABS, 4 },{ Op::DEC, Mode::ABS, 6 },{ Op::XXX, Mode::IMP, 6 },
+    { Op::BNE, Mode::REL, 2 },{ Op::CMP, Mode::IZY, 5 },{ Op::XXX, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 8 },{ Op::NOP, Mode::IMP, 4 },{ Op::CMP, Mode::ZPX, 4 },{ Op::DEC, Mode::ZPX, 6 },{ Op::XXX, Mode::IMP, 6 },{ Op::CLD, Mode::IMP, 2 },{ Op::CMP, Mode::ABY, 4 },{ Op::NOP, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 7 },{ Op::NOP, Mode::IMP, 4 },{ Op::CMP, Mode::ABX, 4 },{ Op::DEC, Mode::ABX, 7 },{ Op::XXX, Mode::IMP, 7 },
+    { Op::CPX, Mode::IMM, 2 },{ Op::SBC, Mode::IZX, 6 },{ Op::NOP, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 8 },{ Op::CPX, Mode::ZP0, 3 },{ Op::SBC, Mode::ZP0, 3 },{ Op::INC, Mode::ZP0, 5 },{ Op::XXX, Mode::IMP, 5 },{ Op::INX, Mode::IMP, 2 },{ Op::SBC, Mode::IMM, 2 },{ Op::NOP, Mode::IMP, 2 },{ Op::SBC, Mode::IMP, 2 },{ Op::CPX, Mode::ABS, 4 },{ Op::SBC, Mode::ABS, 4 },{ Op::INC, Mode::ABS, 6 },{ Op::XXX, Mode::IMP, 6 },
+    { Op::BEQ, Mode::REL, 2 },{ Op::SBC, Mode::IZY, 5 },{ Op::XXX, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 8 },{ Op::NOP, Mode::IMP, 4 },{ Op::SBC, Mode::ZPX, 4 },{ Op::INC, Mode::ZPX, 6 },{ Op::XXX, Mode::IMP, 6 },{ Op::SED, Mode::IMP, 2 },{ Op::SBC, Mode::ABY, 4 },{ Op::NOP, Mode::IMP, 2 },{ Op::XXX, Mode::IMP, 7 },{ Op::NOP, Mode::IMP, 4 },{ Op::SBC, Mode::ABX, 4 },{ Op::INC, Mode::ABX, 7 },{ Op::XXX, Mode::IMP, 7 },
+};
+
+// mnemonics are kept apart from the table above, only the debugger needs them
+static const char *const mnemonics[256] = {
+    "BRK", "ORA", "???", "???", "???", "ORA", "ASL", "???", "PHP", "ORA", "ASL", "???", "???", "ORA", "ASL", "???",
+    "BPL", "ORA", "???", "???", "???", "ORA", "ASL", "???", "CLC", "ORA", "???", "???", "???", "ORA", "ASL", "???",
+    "JSR", "AND", "???", "???", "BIT", "AND", "ROL", "???", "PLP", "AND", "ROL", "???", "BIT", "AND", "ROL", "???",
+    "BMI", "AND", "???", "???", "???", "AND", "ROL", "???", "SEC", "AND", "???", "???", "???", "AND", "ROL", "???",
+    "RTI", "EOR", "???", "???", "???", "EOR", "LSR", "???", "PHA", "EOR", "LSR", "???", "JMP", "EOR", "LSR", "???",
+    "BVC", "EOR", "???", "???", "???", "EOR", "LSR", "???", "CLI", "EOR", "???", "???", "???", "EOR", "LSR", "???",
+    "RTS", "ADC", "???", "???", "???", "ADC", "ROR", "???", "PLA", "ADC", "ROR", "???", "JMP", "ADC", "ROR", "???",
+    "BVS", "ADC", "???", "???", "???", "ADC", "ROR", "???", "SEI", "ADC", "???", "???", "???", "ADC", "ROR", "???",
+    "???", "STA", "???", "???", "STY", "STA", "STX", "???", "DEY", "???", "TXA", "???", "STY", "STA", "STX", "???",
+    "BCC", "STA", "???", "???", "STY", "STA", "STX", "???", "TYA", "STA", "TXS", "???", "???", "STA", "???", "???",
+    "LDY", "LDA", "LDX", "???", "LDY", "LDA", "LDX", "???", "TAY", "LDA", "TAX", "???", "LDY", "LDA", "LDX", "???",
+    "BCS", "LDA", "???", "???", "LDY", "LDA", "LDX", "???", "CLV", "LDA", "TSX", "???", "LDY", "LDA", "LDX", "???",
+    "CPY", "CMP", "???", "???", "CPY", "CMP", "DEC", "???", "INY", "CMP", "DEX", "???", "CPY", "CMP", "DEC", "???",
+    "BNE", "CMP", "???", "???", "???", "CMP", "DEC", "???", "CLD", "CMP", "NOP", "???", "???", "CMP", "DEC", "???",
+    "CPX", "SBC", "???", "???", "CPX", "SBC", "INC", "???", "INX", "SBC", "NOP", "???", "CPX", "SBC", "INC", "???",
+    "BEQ", "SBC", "???", "???", "???", "SBC", "INC", "???", "SED", "SBC", "NOP", "???", "???", "SBC", "INC", "???",
+};
+
+// store instructions only write to addr_abs, jumps and branches only use it as the target
+// none of them should touch the operand (a dummy read could trigger side effects)
+static constexpr bool readsOperand(Op op)
+{
+    switch (op)
+    {
+    case Op::STA: case Op::STX: case Op::STY:
+    case Op::JMP: case Op::JSR: case Op::BRK:
+    case Op::BCC: case Op::BCS: case Op::BEQ: case Op::BMI:
+    case Op::BNE: case Op::BPL: case Op::BVC: case Op::BVS:
+        return false;
+    default:
+        return true;
+    }
+}
+
 MOS6502::MOS6502()
 {
     // power-up state
@@ -34,30 +95,8 @@ MOS6502::MOS6502()
     temp = 0x00;
     cycle = 0;
     total_cycles = 0;
-
-    // instruction set
-    // table taken from OneLoneCoder
-    // I add the accumulator addressing mode
-    // suppose XXX has total cycles of 2
-    using a = MOS6502;
-    this->lookup = {
-        { "BRK", &a::BRK, &a::IMM, 7 },{ "ORA", &a::ORA, &a::IZX, 6 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 3 },{ "ORA", &a::ORA, &a::ZP0, 3 },{ "ASL", &a::ASL, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "PHP", &a::PHP, &a::IMP, 3 },{ "ORA", &a::ORA, &a::IMM, 2 },{ "ASL", &a::ASL, &a::ACC, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::NOP, &a::IMP, 4 },{ "ORA", &a::ORA, &a::ABS, 4 },{ "ASL", &a::ASL, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-        { "BPL", &a::BPL, &a::REL, 2 },{ "ORA", &a::ORA, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "ORA", &a::ORA, &a::ZPX, 4 },{ "ASL", &a::ASL, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "CLC", &a::CLC, &a::IMP, 2 },{ "ORA", &a::ORA, &a::ABY, 4 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "ORA", &a::ORA, &a::ABX, 4 },{ "ASL", &a::ASL, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-        { "JSR", &a::JSR, &a::ABS, 6 },{ "AND", &a::AND, &a::IZX, 6 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "BIT", &a::BIT, &a::ZP0, 3 },{ "AND", &a::AND, &a::ZP0, 3 },{ "ROL", &a::ROL, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "PLP", &a::PLP, &a::IMP, 4 },{ "AND", &a::AND, &a::IMM, 2 },{ "ROL", &a::ROL, &a::ACC, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "BIT", &a::BIT, &a::ABS, 4 },{ "AND", &a::AND, &a::ABS, 4 },{ "ROL", &a::ROL, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-        { "BMI", &a::BMI, &a::REL, 2 },{ "AND", &a::AND, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "AND", &a::AND, &a::ZPX, 4 },{ "ROL", &a::ROL, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "SEC", &a::SEC, &a::IMP, 2 },{ "AND", &a::AND, &a::ABY, 4 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "AND", &a::AND, &a::ABX, 4 },{ "ROL", &a::ROL, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-        { "RTI", &a::RTI, &a::IMP, 6 },{ "EOR", &a::EOR, &a::IZX, 6 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 3 },{ "EOR", &a::EOR, &a::ZP0, 3 },{ "LSR", &a::LSR, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "PHA", &a::PHA, &a::IMP, 3 },{ "EOR", &a::EOR, &a::IMM, 2 },{ "LSR", &a::LSR, &a::ACC, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "JMP", &a::JMP, &a::ABS, 3 },{ "EOR", &a::EOR, &a::ABS, 4 },{ "LSR", &a::LSR, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-        { "BVC", &a::BVC, &a::REL, 2 },{ "EOR", &a::EOR, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "EOR", &a::EOR, &a::ZPX, 4 },{ "LSR", &a::LSR, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "CLI", &a::CLI, &a::IMP, 2 },{ "EOR", &a::EOR, &a::ABY, 4 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "EOR", &a::EOR, &a::ABX, 4 },{ "LSR", &a::LSR, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-        { "RTS", &a::RTS, &a::IMP, 6 },{ "ADC", &a::ADC, &a::IZX, 6 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 3 },{ "ADC", &a::ADC, &a::ZP0, 3 },{ "ROR", &a::ROR, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "PLA", &a::PLA, &a::IMP, 4 },{ "ADC", &a::ADC, &a::IMM, 2 },{ "ROR", &a::ROR, &a::ACC, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "JMP", &a::JMP, &a::IND, 5 },{ "ADC", &a::ADC, &a::ABS, 4 },{ "ROR", &a::ROR, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-        { "BVS", &a::BVS, &a::REL, 2 },{ "ADC", &a::ADC, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "ADC", &a::ADC, &a::ZPX, 4 },{ "ROR", &a::ROR, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "SEI", &a::SEI, &a::IMP, 2 },{ "ADC", &a::ADC, &a::ABY, 4 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "ADC", &a::ADC, &a::ABX, 4 },{ "ROR", &a::ROR, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-        { "???", &a::NOP, &a::IMP, 2 },{ "STA", &a::STA, &a::IZX, 6 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 6 },{ "STY", &a::STY, &a::ZP0, 3 },{ "STA", &a::STA, &a::ZP0, 3 },{ "STX", &a::STX, &a::ZP0, 3 },{ "???", &a::XXX, &a::IMP, 3 },{ "DEY", &a::DEY, &a::IMP, 2 },{ "???", &a::NOP, &a::IMP, 2 },{ "TXA", &a::TXA, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "STY", &a::STY, &a::ABS, 4 },{ "STA", &a::STA, &a::ABS, 4 },{ "STX", &a::STX, &a::ABS, 4 },{ "???", &a::XXX, &a::IMP, 4 },
-        { "BCC", &a::BCC, &a::REL, 2 },{ "STA", &a::STA, &a::IZY, 6 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 6 },{ "STY", &a::STY, &a::ZPX, 4 },{ "STA", &a::STA, &a::ZPX, 4 },{ "STX", &a::STX, &a::ZPY, 4 },{ "???", &a::XXX, &a::IMP, 4 },{ "TYA", &a::TYA, &a::IMP, 2 },{ "STA", &a::STA, &a::ABY, 5 },{ "TXS", &a::TXS, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 5 },{ "???", &a::NOP, &a::IMP, 5 },{ "STA", &a::STA, &a::ABX, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "???", &a::XXX, &a::IMP, 5 },
-        { "LDY", &a::LDY, &a::IMM, 2 },{ "LDA", &a::LDA, &a::IZX, 6 },{ "LDX", &a::LDX, &a::IMM, 2 },{ "???", &a::XXX, &a::IMP, 6 },{ "LDY", &a::LDY, &a::ZP0, 3 },{ "LDA", &a::LDA, &a::ZP0, 3 },{ "LDX", &a::LDX, &a::ZP0, 3 },{ "???", &a::XXX, &a::IMP, 3 },{ "TAY", &a::TAY, &a::IMP, 2 },{ "LDA", &a::LDA, &a::IMM, 2 },{ "TAX", &a::TAX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "LDY", &a::LDY, &a::ABS, 4 },{ "LDA", &a::LDA, &a::ABS, 4 },{ "LDX", &a::LDX, &a::ABS, 4 },{ "???", &a::XXX, &a::IMP, 4 },
-        { "BCS", &a::BCS, &a::REL, 2 },{ "LDA", &a::LDA, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 5 },{ "LDY", &a::LDY, &a::ZPX, 4 },{ "LDA", &a::LDA, &a::ZPX, 4 },{ "LDX", &a::LDX, &a::ZPY, 4 },{ "???", &a::XXX, &a::IMP, 4 },{ "CLV", &a::CLV, &a::IMP, 2 },{ "LDA", &a::LDA, &a::ABY, 4 },{ "TSX", &a::TSX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 4 },{ "LDY", &a::LDY, &a::ABX, 4 },{ "LDA", &a::LDA, &a::ABX, 4 },{ "LDX", &a::LDX, &a::ABY, 4 },{ "???", &a::XXX, &a::IMP, 4 },
-        { "CPY", &a::CPY, &a::IMM, 2 },{ "CMP", &a::CMP, &a::IZX, 6 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "CPY", &a::CPY, &a::ZP0, 3 },{ "CMP", &a::CMP, &a::ZP0, 3 },{ "DEC", &a::DEC, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "INY", &a::INY, &a::IMP, 2 },{ "CMP", &a::CMP, &a::IMM, 2 },{ "DEX", &a::DEX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 2 },{ "CPY", &a::CPY, &a::ABS, 4 },{ "CMP", &a::CMP, &a::ABS, 4 },{ "DEC", &a::DEC, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-        { "BNE", &a::BNE, &a::REL, 2 },{ "CMP", &a::CMP, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "CMP", &a::CMP, &a::ZPX, 4 },{ "DEC", &a::DEC, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "CLD", &a::CLD, &a::IMP, 2 },{ "CMP", &a::CMP, &a::ABY, 4 },{ "NOP", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "CMP", &a::CMP, &a::ABX, 4 },{ "DEC", &a::DEC, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-        { "CPX", &a::CPX, &a::IMM, 2 },{ "SBC", &a::SBC, &a::IZX, 6 },{ "???", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "CPX", &a::CPX, &a::ZP0, 3 },{ "SBC", &a::SBC, &a::ZP0, 3 },{ "INC", &a::INC, &a::ZP0, 5 },{ "???", &a::XXX, &a::IMP, 5 },{ "INX", &a::INX, &a::IMP, 2 },{ "SBC", &a::SBC, &a::IMM, 2 },{ "NOP", &a::NOP, &a::IMP, 2 },{ "???", &a::SBC, &a::IMP, 2 },{ "CPX", &a::CPX, &a::ABS, 4 },{ "SBC", &a::SBC, &a::ABS, 4 },{ "INC", &a::INC, &a::ABS, 6 },{ "???", &a::XXX, &a::IMP, 6 },
-        { "BEQ", &a::BEQ, &a::REL, 2 },{ "SBC", &a::SBC, &a::IZY, 5 },{ "???", &a::XXX, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 8 },{ "???", &a::NOP, &a::IMP, 4 },{ "SBC", &a::SBC, &a::ZPX, 4 },{ "INC", &a::INC, &a::ZPX, 6 },{ "???", &a::XXX, &a::IMP, 6 },{ "SED", &a::SED, &a::IMP, 2 },{ "SBC", &a::SBC, &a::ABY, 4 },{ "NOP", &a::NOP, &a::IMP, 2 },{ "???", &a::XXX, &a::IMP, 7 },{ "???", &a::NOP, &a::IMP, 4 },{ "SBC", &a::SBC, &a::ABX, 4 },{ "INC", &a::INC, &a::ABX, 7 },{ "???", &a::XXX, &a::IMP, 7 },
-    };
+    nmiPending = false;
+    irqLine = false;
 }
 
 MOS6502::~MOS6502()
@@ -88,6 +127,11 @@ uint8_t MOS6502::pop() // pop one byte from stack
     return read(0x0100 + SP, false);
 }
 
+const char *MOS6502::mnemonic(uint8_t opcode)
+{
+    return mnemonics[opcode];
+}
+
 void MOS6502::OAMDMA(uint8_t addr, RICOH2C02 *ppu)
 {
     cycle = 513 + (total_cycles & 1);
@@ -96,18 +140,19 @@ void MOS6502::OAMDMA(uint8_t addr, RICOH2C02 *ppu)
         ppu->setOAM(i >> 2, i & 0x03, read(startAddr + i, false));
 }
 
-uint8_t MOS6502::fetch(bool readOnly)
+void MOS6502::connectBus(Bus *bus)
 {
-    if (this->lookup[IR].mode != &MOS6502::ACC && this->lookup[IR].mode != &MOS6502::IMP)
-        fetched = read(addr_abs, readOnly);
-    else if (this->lookup[IR].mode != &MOS6502::ACC)
-        fetched = 0;
-    return fetched;
+    this->bus = bus;
 }
 
-void MOS6502::connectBus(Bus *bus)
+void MOS6502::setNMI()
 {
-    this->bus = bus;
+    nmiPending = true;
+}
+
+void MOS6502::setIRQ(bool active)
+{
+    irqLine = active;
 }
 
 void MOS6502::irq()
@@ -152,6 +197,8 @@ void MOS6502::reset()
     temp = 0x00;
     cycle = 7; // it takes 7 cycles to fetch the first actual instruction
     total_cycles = 0;
+    nmiPending = false;
+    irqLine = false;
 }
 
 bool MOS6502::complete()
@@ -163,25 +210,162 @@ bool MOS6502::complete()
 
 void MOS6502::clock()
 {
-    IR = read(PC, true);
     if (cycle == 0) // execution finished
-    {
-        IR = read(PC++, false);
-
-        cycle = this->lookup[IR].cycle;
-        uint8_t extra1 = (this->*lookup[IR].mode)();
-        if (lookup[IR].name == "STA" || lookup[IR].name == "STX" || lookup[IR].name == "STY")
-            fetch(true);
-        else
-            fetch(false);
-        uint8_t extra2 = (this->*lookup[IR].operation)();
-        if (extra1 && extra2)
-            cycle++;
-    }
+        step();
     cycle--;
     total_cycles++;
 }
 
+unsigned int MOS6502::run(unsigned int budget)
+{
+    // first finish whatever clock() or an interrupt left in cycle
+    unsigned int consumed = cycle;
+    total_cycles += cycle;
+    cycle = 0;
+    while (consumed < budget)
+    {
+        step();
+        consumed += cycle;
+        total_cycles += cycle;
+        cycle = 0;
+    }
+    return consumed;
+}
+
+void MOS6502::step()
+{
+    // interrupts are only polled between instructions
+    // nmi wins if both are pending
+    if (nmiPending)
+    {
+        nmiPending = false;
+        nmi();
+        return;
+    }
+    if (irqLine && !I)
+    {
+        irq();
+        return;
+    }
+    IR = read(PC++, false);
+    switch (IR)
+    {
+#define OPCODE_CASE(n) case (n): execute<(n)>(); break;
+#define OPCODE_CASE4(n) OPCODE_CASE(n) OPCODE_CASE((n) + 1) OPCODE_CASE((n) + 2) OPCODE_CASE((n) + 3)
+#define OPCODE_CASE16(n) OPCODE_CASE4(n) OPCODE_CASE4((n) + 4) OPCODE_CASE4((n) + 8) OPCODE_CASE4((n) + 12)
+#define OPCODE_CASE64(n) OPCODE_CASE16(n) OPCODE_CASE16((n) + 16) OPCODE_CASE16((n) + 32) OPCODE_CASE16((n) + 48)
+    OPCODE_CASE64(0x00)
+    OPCODE_CASE64(0x40)
+    OPCODE_CASE64(0x80)
+    OPCODE_CASE64(0xC0)
+#undef OPCODE_CASE64
+#undef OPCODE_CASE16
+#undef OPCODE_CASE4
+#undef OPCODE_CASE
+    }
+}
+
+template <uint8_t OPCODE>
+void MOS6502::execute()
+{
+    constexpr Instruction instr = lookup[OPCODE];
+    cycle = instr.cycle;
+    uint8_t extra1 = address<instr.mode>();
+    fetch<instr.operation, instr.mode>();
+    uint8_t extra2 = operate<instr.operation, instr.mode>();
+    if (extra1 && extra2)
+        cycle++;
+}
+
+template <MOS6502::Mode M>
+uint8_t MOS6502::address()
+{
+    if constexpr (M == Mode::ACC) return ACC();
+    else if constexpr (M == Mode::ABS) return ABS();
+    else if constexpr (M == Mode::ABX) return ABX();
+    else if constexpr (M == Mode::ABY) return ABY();
+    else if constexpr (M == Mode::IMM) return IMM();
+    else if constexpr (M == Mode::IMP) return IMP();
+    else if constexpr (M == Mode::IND) return IND();
+    else if constexpr (M == Mode::IZX) return IZX();
+    else if constexpr (M == Mode::IZY) return IZY();
+    else if constexpr (M == Mode::REL) return REL();
+    else if constexpr (M == Mode::ZP0) return ZP0();
+    else if constexpr (M == Mode::ZPX) return ZPX();
+    else return ZPY();
+}
+
+template <MOS6502::Op O, MOS6502::Mode M>
+void MOS6502::fetch()
+{
+    if constexpr (M == Mode::IMP)
+        fetched = 0;
+    else if constexpr (M != Mode::ACC && readsOperand(O))
+        fetched = read(addr_abs, false);
+}
+
+template <MOS6502::Op O, MOS6502::Mode M>
+uint8_t MOS6502::operate()
+{
+    if constexpr (O == Op::ADC) return ADC();
+    else if constexpr (O == Op::AND) return AND();
+    else if constexpr (O == Op::ASL) return ASL<M>();
+    else if constexpr (O == Op::BCC) return BCC();
+    else if constexpr (O == Op::BCS) return BCS();
+    else if constexpr (O == Op::BEQ) return BEQ();
+    else if constexpr (O == Op::BIT) return BIT();
+    else if constexpr (O == Op::BMI) return BMI();
+    else if constexpr (O == Op::BNE) return BNE();
+    else if constexpr (O == Op::BPL) return BPL();
+    else if constexpr (O == Op::BRK) return BRK();
+    else if constexpr (O == Op::BVC) return BVC();
+    else if constexpr (O == Op::BVS) return BVS();
+    else if constexpr (O == Op::CLC) return CLC();
+    else if constexpr (O == Op::CLD) return CLD();
+    else if constexpr (O == Op::CLI) return CLI();
+    else if constexpr (O == Op::CLV) return CLV();
+    else if constexpr (O == Op::CMP) return CMP();
+    else if constexpr (O == Op::CPX) return CPX();
+    else if constexpr (O == Op::CPY) return CPY();
+    else if constexpr (O == Op::DEC) return DEC();
+    else if constexpr (O == Op::DEX) return DEX();
+    else if constexpr (O == Op::DEY) return DEY();
+    else if constexpr (O == Op::EOR) return EOR();
+    else if constexpr (O == Op::INC) return INC();
+    else if constexpr (O == Op::INX) return INX();
+    else if constexpr (O == Op::INY) return INY();
+    else if constexpr (O == Op::JMP) return JMP();
+    else if constexpr (O == Op::JSR) return JSR();
+    else if constexpr (O == Op::LDA) return LDA();
+    else if constexpr (O == Op::LDX) return LDX();
+    else if constexpr (O == Op::LDY) return LDY();
+    else if constexpr (O == Op::LSR) return LSR<M>();
+    else if constexpr (O == Op::NOP) return NOP();
+    else if constexpr (O == Op::ORA) return ORA();
+    else if constexpr (O == Op::PHA) return PHA();
+    else if constexpr (O == Op::PHP) return PHP();
+    else if constexpr (O == Op::PLA) return PLA();
+    else if constexpr (O == Op::PLP) return PLP();
+    else if constexpr (O == Op::ROL) return ROL<M>();
+    else if constexpr (O == Op::ROR) return ROR<M>();
+    else if constexpr (O == Op::RTI) return RTI();
+    else if constexpr (O == Op::RTS) return RTS();
+    else if constexpr (O == Op::SBC) return SBC();
+    else if constexpr (O == Op::SEC) return SEC();
+    else if constexpr (O == Op::SED) return SED();
+    else if constexpr (O == Op::SEI) return SEI();
+    else if constexpr (O == Op::STA) return STA();
+    else if constexpr (O == Op::STX) return STX();
+    else if constexpr (O == Op::STY) return STY();
+    else if constexpr (O == Op::TAX) return TAX();
+    else if constexpr (O == Op::TAY) return TAY();
+    else if constexpr (O == Op::TSX) return TSX();
+    else if constexpr (O == Op::TXA) return TXA();
+    else if constexpr (O == Op::TXS) return TXS();
+    else if constexpr (O == Op::TYA) return TYA();
+    else return XXX();
+}
+
 /*
 A      Accumulator          OPC A	     operand is AC (implied single byte instruction)
 abs    absolute	            OPC $LLHH	 operand is address $HHLL *
@@ -331,6 +515,7 @@ uint8_t MOS6502::AND()
     return 1;
 }
 
+template <MOS6502::Mode M>
 uint8_t MOS6502::ASL()
 {
     temp = fetched;
@@ -338,7 +523,7 @@ uint8_t MOS6502::ASL()
     temp <<= 1;
     Z = temp == 0;
     N = sign(temp);
-    if (lookup[IR].mode == &MOS6502::ACC)
+    if constexpr (M == Mode::ACC)
         A = temp;
     else
         write(addr_abs, temp);
@@ -600,6 +785,7 @@ uint8_t MOS6502::LDY()
     return 1;
 }
 
+template <MOS6502::Mode M>
 uint8_t MOS6502::LSR()
 {
     temp = fetched;
@@ -607,7 +793,7 @@ uint8_t MOS6502::LSR()
     temp >>= 1;
     Z = temp == 0;
     N = sign(temp);
-    if (lookup[IR].mode == &MOS6502::ACC)
+    if constexpr (M == Mode::ACC)
         A = temp;
     else
         write(addr_abs, temp);
@@ -653,6 +839,7 @@ uint8_t MOS6502::PLP()
     return 0;
 }
 
+template <MOS6502::Mode M>
 uint8_t MOS6502::ROL()
 {
     temp = fetched;
@@ -661,13 +848,14 @@ uint8_t MOS6502::ROL()
     C = C1;
     Z = temp == 0;
     N = sign(temp);
-    if (lookup[IR].mode == &MOS6502::ACC)
+    if constexpr (M == Mode::ACC)
         A = temp;
     else
         write(addr_abs, temp);
     return 0;
 }
 
+template <MOS6502::Mode M>
 uint8_t MOS6502::ROR()
 {
     temp = fetched;
@@ -676,7 +864,7 @@ uint8_t MOS6502::ROR()
     C = C1;
     Z = temp == 0;
     N = sign(temp);
-    if (lookup[IR].mode == &MOS6502::ACC)
+    if constexpr (M == Mode::ACC)
         A = temp;
     else
         write(addr_abs, temp);
@@ -3,8 +3,6 @@
 
 #include "bus.h"
 #include <cstdint>
-#include <string.h>
-#include <string>
 #include "ricoh2c02.h"
 
 class MOS6502
@@ -16,15 +14,30 @@ public:
 private:
     Bus *bus;
     uint8_t temp; // to avoid changing fetched
-    uint8_t fetch(bool readOnly); // fetch operand into fetched
     uint16_t cycle; // clock count left to complete current instruction
                     // when it hits 0, fetch a new instruction then execute
+    bool nmiPending; // nmi is edge triggered, latched until serviced
+    bool irqLine; // irq is level triggered, held by its source
 
 public:
     uint8_t fetched; // current operand
     uint16_t addr_abs; // for direct addressing mode
     unsigned long long total_cycles;
 
+public:
+    enum class Mode : uint8_t
+    {
+        ACC, ABS, ABX, ABY, IMM, IMP, IND, IZX, IZY, REL, ZP0, ZPX, ZPY
+    };
+    enum class Op : uint8_t
+    {
+        ADC, AND, ASL, BCC, BCS, BEQ, BIT, BMI, BNE, BPL, BRK, BVC, BVS, CLC,
+        CLD, CLI, CLV, CMP, CPX, CPY, DEC, DEX, DEY, EOR, INC, INX, INY, JMP,
+        JSR, LDA, LDX, LDY, LSR, NOP, ORA, PHA, PHP, PLA, PLP, ROL, ROR, RTI,
+        RTS, SBC, SEC, SED, SEI, STA, STX, STY, TAX, TAY, TSX, TXA, TXS, TYA,
+        XXX // illegal opcode
+    };
+
 private:
     // addressing modes
     // 6502 has 13 addressing modes, including these 12
@@ -54,24 +67,34 @@ private:
 
     // the return value helps to judge potential extra cycle
     // legal opcodes
-    uint8_t ADC(); uint8_t AND(); uint8_t ASL(); uint8_t BCC(); uint8_t BCS(); uint8_t BEQ(); uint8_t BIT(); uint8_t BMI(); uint8_t BNE(); uint8_t BPL(); uint8_t BRK(); uint8_t BVC(); uint8_t BVS(); uint8_t CLC();
+    // shifts and rotates write back to A or memory depending on the addressing mode
+    template <Mode M> uint8_t ASL(); template <Mode M> uint8_t LSR(); template <Mode M> uint8_t ROL(); template <Mode M> uint8_t ROR();
+    uint8_t ADC(); uint8_t AND(); uint8_t BCC(); uint8_t BCS(); uint8_t BEQ(); uint8_t BIT(); uint8_t BMI(); uint8_t BNE(); uint8_t BPL(); uint8_t BRK(); uint8_t BVC(); uint8_t BVS(); uint8_t CLC();
     uint8_t CLD(); uint8_t CLI(); uint8_t CLV(); uint8_t CMP(); uint8_t CPX(); uint8_t CPY(); uint8_t DEC(); uint8_t DEX(); uint8_t DEY(); uint8_t EOR(); uint8_t INC(); uint8_t INX(); uint8_t INY(); uint8_t JMP();
-    uint8_t JSR(); uint8_t LDA(); uint8_t LDX(); uint8_t LDY(); uint8_t LSR(); uint8_t NOP(); uint8_t ORA(); uint8_t PHA(); uint8_t PHP(); uint8_t PLA(); uint8_t PLP(); uint8_t ROL(); uint8_t ROR(); uint8_t RTI();
+    uint8_t JSR(); uint8_t LDA(); uint8_t LDX(); uint8_t LDY(); uint8_t NOP(); uint8_t ORA(); uint8_t PHA(); uint8_t PHP(); uint8_t PLA(); uint8_t PLP(); uint8_t RTI();
     uint8_t RTS(); uint8_t SBC(); uint8_t SEC(); uint8_t SED(); uint8_t SEI(); uint8_t STA(); uint8_t STX(); uint8_t STY(); uint8_t TAX(); uint8_t TAY(); uint8_t TSX(); uint8_t TXA(); uint8_t TXS(); uint8_t TYA();
 
     // illegal opcode
     uint8_t XXX();
 
 public:
+    // every opcode is decoded at compile time from the constexpr table in mos6502.cpp
+    // into its own kernel, execute<opcode>(), with mode, operation and cycles baked in
     struct Instruction
     {
-        std::string name;
-        uint8_t (MOS6502::*operation)(void);
-        uint8_t (MOS6502::*mode)(void);
+        Op operation;
+        Mode mode;
         uint8_t cycle;
     };
 
-    std::vector<Instruction> lookup;
+    static const char *mnemonic(uint8_t opcode); // for debug only
+
+private:
+    template <Mode M> uint8_t address(); // resolve addr_abs for addressing mode M
+    template <Op O, Mode M> void fetch(); // fetch operand into fetched
+    template <Op O, Mode M> uint8_t operate(); // run the operation O
+    template <uint8_t OPCODE> void execute(); // one specialized kernel per opcode
+    void step(); // fetch, decode and execute one whole instruction
 
 public:
     void connectBus(Bus *bus);
@@ -108,8 +131,11 @@ public: // registers
 public: // execution and interrupts
     void OAMDMA(uint8_t addr, RICOH2C02 *ppu); // start transfer data to OAM in PPU
     void clock(); // let cpu run 1 clock cycle
-    void irq(); // maskable interrupt
-    void nmi(); // non maskable interrupt
+    unsigned int run(unsigned int budget); // run whole instructions until budget cycles are used, return cycles consumed
+    void setNMI(); // raise nmi, taken before the next instruction
+    void setIRQ(bool active); // drive the irq line, taken before the next instruction if I is clear
+    void irq(); // maskable interrupt, push state and jump to the vector right away
+    void nmi(); // non maskable interrupt, push state and jump to the vector right away
     void reset(); // forced reset
     bool complete(); // check if current instruction complete
 };
@@ -0,0 +1,16 @@
+#ifndef NESCORE_H
+#define NESCORE_H
+
+// everything needed to put a console together without Qt, see main.cpp or headless.cpp
+// link against nes_core
+#include "global.h"
+#include "cartridge.h"
+#include "mapper.h"
+#include "mos6502.h"
+#include "ricoh2c02.h"
+#include "frame.h"
+#include "bus.h"
+#include "controller.h"
+#include "scheduler.h"
+
+#endif // NESCORE_H
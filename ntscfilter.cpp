@@ -0,0 +1,150 @@
+#include "ntscfilter.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define NTSC_SSE2
+#endif
+
+// voltage levels relative to sync, from the nesdev wiki
+static const float signalBlack = 0.518f;
+static const float signalWhite = 1.962f;
+static const float attenuation = 0.746f; // emphasis
+static const float levels[8] = {
+    0.350f, 0.518f, 0.962f, 1.550f, // signal low
+    1.094f, 1.506f, 1.962f, 1.962f  // signal high
+};
+static const float hue = 3.9f; // decoder phase tweak, in 1/12 of a colour cycle
+static const double PI = 3.14159265358979323846;
+
+// normalised level of the square wave for value (emphasis << 6 | colour) at subcarrier phase 0-11
+static float signal(int value, int phase)
+{
+    int colour = (value & 0x0F);
+    int level = ((value >> 4) & 0x03);
+    int emphasis = (value >> 6);
+    if (colour > 13) // $xE and $xF are forced to level 1
+        level = 1;
+    float low = levels[level];
+    float high = levels[4 + level];
+    if (colour == 0) // only high level
+        low = high;
+    if (colour > 12) // only low level
+        high = low;
+    auto inColourPhase = [phase](int c) { return (c + phase) % 12 < 6; };
+    float s = (inColourPhase(colour) ? high : low);
+    if (((emphasis & 1) && inColourPhase(0)) ||
+        ((emphasis & 2) && inColourPhase(4)) ||
+        ((emphasis & 4) && inColourPhase(8)))
+        s *= attenuation;
+    return (s - signalBlack) / (signalWhite - signalBlack);
+}
+
+NtscFilter::NtscFilter(int resolution)
+{
+    this->resolution = 0;
+    setResolution(resolution);
+}
+
+void NtscFilter::setResolution(int resolution)
+{
+    resolution = std::clamp(resolution, 1, MAX_RESOLUTION);
+    if (resolution == this->resolution)
+        return;
+    this->resolution = resolution;
+    buildKernels();
+}
+
+int NtscFilter::getResolution()
+{
+    return resolution;
+}
+
+int NtscFilter::outputWidth()
+{
+    return 256 * resolution;
+}
+
+const float *NtscFilter::kernel(int phase, int position, int tap)
+{
+    return kernels.data() + ((phase * resolution + position) * 3 + tap) * 512 * 4;
+}
+
+void NtscFilter::buildKernels()
+{
+    // a pixel starts 8 samples after the previous one and a line 2728 (341 * 8) after the previous line,
+    // so the subcarrier phase at the start of a pixel is always 0, 4 or 8
+    kernels.assign(3 * resolution * 3 * 512 * 4, 0.0f);
+    for (int phase = 0; phase < 3; phase++)
+    {
+        for (int position = 0; position < resolution; position++)
+        {
+            // window of 12 samples around the centre of the output pixel, relative to the pixel start
+            int centre = (int)((position + 0.5) * 8 / resolution);
+            for (int value = 0; value < 512; value++)
+            {
+                float yiq[3][3] = {}; // [tap][Y, I, Q]
+                for (int n = centre - 6; n < centre + 6; n++)
+                {
+                    int tap = (n < 0 ? 0 : (n < 8 ? 1 : 2));
+                    int p = (((n + phase * 4) % 12) + 12) % 12;
+                    float s = signal(value, p);
+                    yiq[tap][0] += s;
+                    yiq[tap][1] += s * std::cos(PI * (p + hue) / 6);
+                    yiq[tap][2] += s * std::sin(PI * (p + hue) / 6);
+                }
+                for (int tap = 0; tap < 3; tap++)
+                {
+                    // FCC YIQ to RGB
+                    float Y = yiq[tap][0] / 12, I = yiq[tap][1] / 12, Q = yiq[tap][2] / 12;
+                    float *entry = (float *)kernel(phase, position, tap) + value * 4;
+                    entry[0] = 255 * (Y + 0.946882f * I + 0.623557f * Q);
+                    entry[1] = 255 * (Y - 0.274788f * I - 0.635691f * Q);
+                    entry[2] = 255 * (Y - 1.108545f * I + 1.709007f * Q);
+                }
+            }
+        }
+    }
+}
+
+void NtscFilter::process(const uint8_t *indices, const uint8_t *emphasis, uint32_t *out)
+{
+    int width = outputWidth();
+    for (int y = 0; y < 240; y++)
+    {
+        // one black pixel of padding on both sides for the outer taps
+        int e = ((emphasis[y] & 0x07) << 6);
+        uint16_t values[258];
+        values[0] = values[257] = (e | 0x0F);
+        for (int x = 0; x < 256; x++)
+            values[x + 1] = (e | (indices[y * 256 + x] & 0x3F));
+        uint32_t *line = out + y * width;
+        for (int x = 0; x < 256; x++)
+        {
+            int phase = ((x * 2 + y) % 3); // (8x + 4y) mod 12, in units of 4
+            for (int position = 0; position < resolution; position++)
+            {
+                const float *left = kernel(phase, position, 0) + values[x] * 4;
+                const float *centre = kernel(phase, position, 1) + values[x + 1] * 4;
+                const float *right = kernel(phase, position, 2) + values[x + 2] * 4;
+#ifdef NTSC_SSE2
+                __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(left), _mm_loadu_ps(centre)), _mm_loadu_ps(right));
+                __m128i rgb = _mm_cvtps_epi32(sum);
+                rgb = _mm_packs_epi32(rgb, rgb);
+                rgb = _mm_packus_epi16(rgb, rgb); // saturates to 0-255
+                line[x * resolution + position] = (_mm_cvtsi128_si32(rgb) | 0xFF000000);
+#else
+                uint32_t pixel = 0xFF000000;
+                for (int c = 0; c < 3; c++)
+                {
+                    int v = (int)std::lround(left[c] + centre[c] + right[c]);
+                    pixel |= ((uint32_t)std::clamp(v, 0, 255) << (c * 8));
+                }
+                line[x * resolution + position] = pixel;
+#endif
+            }
+        }
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef NTSCFILTER_H
+#define NTSCFILTER_H
+
+#include <cstdint>
+#include <vector>
+
+// https://www.nesdev.org/wiki/NTSC_video
+// rebuilds the composite signal the ppu would send to the tv from palette indices and emphasis,
+// then decodes it again, which gives the colour fringes and blending games were drawn for
+//
+// the ppu emits 8 signal samples per pixel and the colour subcarrier repeats every 12,
+// every output pixel is decoded from a 12 sample window, so it sees at most 3 neighbouring pixels
+// the decoder is linear, so what each (pixel value, window position) adds to the output
+// is worked out once per resolution and a frame is just 3 table lookups and adds per output pixel
+class NtscFilter
+{
+public:
+    static constexpr int MAX_RESOLUTION = 4;
+
+public:
+    NtscFilter(int resolution = 2);
+    void setResolution(int resolution); // output pixels per ppu pixel, 1 to MAX_RESOLUTION
+    int getResolution();
+    int outputWidth(); // 256 * resolution
+    // indices: 256x240 colour indices, emphasis: PPUMASK emphasis bits of every line (see Frame)
+    // out: outputWidth() x 240 RGBX8888
+    void process(const uint8_t *indices, const uint8_t *emphasis, uint32_t *out);
+
+private:
+    int resolution;
+    // [line phase][position in the pixel][tap: left, centre, right neighbour][emphasis << 6 | colour]
+    // each entry R, G, B, pad as floats already scaled to 0-255
+    std::vector<float> kernels;
+    const float *kernel(int phase, int position, int tap); // 512 entries of 4 floats
+    void buildKernels();
+};
+
+#endif // NTSCFILTER_H
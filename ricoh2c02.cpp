@@ -1,94 +1,120 @@
 #include "ricoh2c02.h"
+#include "mapper000.h"
+#include "mapper001.h"
+#include "mapper002.h"
 
+#include <algorithm>
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
 #include <iomanip>
+#include <fstream>
 
-RICOH2C02::RICOH2C02()
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// index of the lowest set bit, x must not be 0
+static inline int ctz64(uint64_t x)
 {
-    // initialize palette
-    std::string path = "";
-    if (initColourTable(""))
+#if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long n;
+    _BitScanForward64(&n, x);
+    return (int)n;
+#else
+    int n = 0;
+    while (!(x & 1))
     {
-        std::cout << "Palette loaded from " << path << std::endl;
-    }
-    else
-    {
-        uint8_t _colourTable[64][3] {
-            0x5A, 0x53, 0x5E,
-            0x00, 0x17, 0x7E,
-            0x00, 0x08, 0x93,
-            0x2F, 0x06, 0x83,
-            0x5C, 0x03, 0x54,
-            0x75, 0x00, 0x13,
-            0x71, 0x00, 0x00,
-            0x4F, 0x08, 0x00,
-            0x18, 0x1B, 0x00,
-            0x00, 0x29, 0x00,
-            0x00, 0x2F, 0x00,
-            0x00, 0x2D, 0x09,
-            0x00, 0x25, 0x4C,
-            0x00, 0x00, 0x00,
-            0x00, 0x00, 0x00,
-            0x00, 0x00, 0x00,
-            0xAE, 0xA1, 0xB6,
-            0x00, 0x55, 0xD9,
-            0x24, 0x3E, 0xFB,
-            0x71, 0x29, 0xEE,
-            0xB3, 0x1A, 0xB6,
-            0xD9, 0x17, 0x62,
-            0xD9, 0x20, 0x08,
-            0xAD, 0x35, 0x00,
-            0x68, 0x4E, 0x00,
-            0x1C, 0x63, 0x00,
-            0x00, 0x6F, 0x00,
-            0x00, 0x70, 0x37,
-            0x00, 0x67, 0x91,
-            0x00, 0x00, 0x00,
-            0x00, 0x00, 0x00,
-            0x00, 0x00, 0x00,
-            0xFF, 0xF9, 0xFF,
-            0x3B, 0xA3, 0xFF,
-            0x65, 0x80, 0xFF,
-            0xA1, 0x71, 0xFF,
-            0xF9, 0x76, 0xFF,
-            0xFF, 0x78, 0xCD,
-            0xFF, 0x7E, 0x81,
-            0xFF, 0x87, 0x34,
-            0xD8, 0x9B, 0x00,
-            0x8A, 0xB2, 0x04,
-            0x43, 0xC2, 0x36,
-            0x17, 0xC7, 0x88,
-            0x11, 0xC0, 0xE5,
-            0x40, 0x3B, 0x43,
-            0x00, 0x00, 0x00,
-            0x00, 0x00, 0x00,
-            0xFF, 0xF9, 0xFF,
-            0xB1, 0xD9, 0xFF,
-            0xBB, 0xC4, 0xFF,
-            0xD5, 0xBB, 0xFF,
-            0xFC, 0xC0, 0xFF,
-            0xFF, 0xC2, 0xFF,
-            0xFF, 0xC4, 0xDC,
-            0xFF, 0xC8, 0xBD,
-            0xFB, 0xD0, 0xA6,
-            0xDC, 0xDA, 0xA5,
-            0xBD, 0xE1, 0xB7,
-            0xA9, 0xE4, 0xD7,
-            0xA4, 0xE2, 0xFD,
-            0xB8, 0xAA, 0xC0,
-            0x00, 0x00, 0x00,
-            0x00, 0x00, 0x00
-        };
-        memcpy(colourTable, _colourTable, 64 * 3);
+        x >>= 1;
+        n++;
     }
+    return n;
+#endif
+}
+
+// 2C02 colours used when no palette file is given
+static const uint8_t defaultColours[64][3] {
+    0x5A, 0x53, 0x5E,
+    0x00, 0x17, 0x7E,
+    0x00, 0x08, 0x93,
+    0x2F, 0x06, 0x83,
+    0x5C, 0x03, 0x54,
+    0x75, 0x00, 0x13,
+    0x71, 0x00, 0x00,
+    0x4F, 0x08, 0x00,
+    0x18, 0x1B, 0x00,
+    0x00, 0x29, 0x00,
+    0x00, 0x2F, 0x00,
+    0x00, 0x2D, 0x09,
+    0x00, 0x25, 0x4C,
+    0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00,
+    0xAE, 0xA1, 0xB6,
+    0x00, 0x55, 0xD9,
+    0x24, 0x3E, 0xFB,
+    0x71, 0x29, 0xEE,
+    0xB3, 0x1A, 0xB6,
+    0xD9, 0x17, 0x62,
+    0xD9, 0x20, 0x08,
+    0xAD, 0x35, 0x00,
+    0x68, 0x4E, 0x00,
+    0x1C, 0x63, 0x00,
+    0x00, 0x6F, 0x00,
+    0x00, 0x70, 0x37,
+    0x00, 0x67, 0x91,
+    0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00,
+    0xFF, 0xF9, 0xFF,
+    0x3B, 0xA3, 0xFF,
+    0x65, 0x80, 0xFF,
+    0xA1, 0x71, 0xFF,
+    0xF9, 0x76, 0xFF,
+    0xFF, 0x78, 0xCD,
+    0xFF, 0x7E, 0x81,
+    0xFF, 0x87, 0x34,
+    0xD8, 0x9B, 0x00,
+    0x8A, 0xB2, 0x04,
+    0x43, 0xC2, 0x36,
+    0x17, 0xC7, 0x88,
+    0x11, 0xC0, 0xE5,
+    0x40, 0x3B, 0x43,
+    0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00,
+    0xFF, 0xF9, 0xFF,
+    0xB1, 0xD9, 0xFF,
+    0xBB, 0xC4, 0xFF,
+    0xD5, 0xBB, 0xFF,
+    0xFC, 0xC0, 0xFF,
+    0xFF, 0xC2, 0xFF,
+    0xFF, 0xC4, 0xDC,
+    0xFF, 0xC8, 0xBD,
+    0xFB, 0xD0, 0xA6,
+    0xDC, 0xDA, 0xA5,
+    0xBD, 0xE1, 0xB7,
+    0xA9, 0xE4, 0xD7,
+    0xA4, 0xE2, 0xFD,
+    0xB8, 0xAA, 0xC0,
+    0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00
+};
+
+RICOH2C02::RICOH2C02()
+{
+    // initialize palette
+    initColourTable("");
 
     scanline = 0; // pre-render scanline
-    totalCycles = -3 * 7; // wait cpu to reset
-    renderCycle = -3 * 7; // wait cpu to reset
+    totalCycles = 0;
+    renderCycle = 0;
+    frameCount = 0;
     // power-up state
     *(uint8_t*)&PPUCTRL = 0;
     *(uint8_t*)&PPUMASK = 0;
+    maskChanged();
     *(uint8_t*)&PPUSTATUS = 0;
     *(uint8_t*)&PPUSCROLL = 0;
     *(uint8_t*)&PPUSTATUS = 0;
@@ -99,8 +125,19 @@ RICOH2C02::RICOH2C02()
     internalBuffer = 0;
     V = T = X = 0;
     W = false;
+    X0 = 0;
+    fetchAddr = 0;
+    attrOffset = 0;
+    std::fill(latch, latch + 2, 0);
+    bgWindow[0] = bgWindow[1] = 0;
+    std::fill(sprLine, sprLine + 256, 0);
+    evalN = evalP = evalStage = 0;
+    lineSpritesDirty = true;
     renderBg = renderSpr = true;
     okFlag = false;
+    kernel = &RICOH2C02::runWith<Mapper>;
+    renderMode = RENDER_SCANLINE;
+    skipOutput = false;
 }
 
 void RICOH2C02::connectBus(Bus *bus)
@@ -173,11 +210,14 @@ void RICOH2C02::writeReg(uint16_t addr, uint8_t value)
     switch (addr)
     {
     case 0x2000:
+        if (((value >> 5) & 0x01) != PPUCTRL.H) // sprite size changes which lines a sprite covers
+            lineSpritesDirty = true;
         *(uint8_t*)(&PPUCTRL) = value;
         T = (((value & 0x3) << 10) | (T & (~0x0C00)));
         break;
     case 0x2001:
         *(uint8_t*)(&PPUMASK) = value;
+        maskChanged();
         break;
     case 0x2003:
         OAMADDR = value;
@@ -185,6 +225,8 @@ void RICOH2C02::writeReg(uint16_t addr, uint8_t value)
     case 0x2004:
         OAMDATA = value;
         *((uint8_t*)OAM + OAMADDR) = OAMDATA;
+        if (!(OAMADDR & 0x03))
+            lineSpritesDirty = true;
         OAMADDR++;
         break;
     case 0x2005: // PPUSCROLL write x2
@@ -259,35 +301,110 @@ void RICOH2C02::writeReg(uint16_t addr, uint8_t value)
 
 void RICOH2C02::clock()
 {
-    // Render background and sprites
-    render();
+    (this->*kernel)(1);
+}
 
-    // Sprite Evaluation
-    spriteEval();
+void RICOH2C02::clock3()
+{
+    (this->*kernel)(3);
+}
 
-    if (scanline == 239 && renderCycle == 256)
-        frame.swapBuffer();
-    if (scanline == 261 && renderCycle == 339 && (PPUMASK.s || PPUMASK.b))
-        renderCycle++; // skip one cycle
-    if (scanline == 261 && renderCycle == 340)
-        oddFlag = !oddFlag;
-    if (renderCycle == 340)
-        scanline = (scanline + 1) % 262;
-    renderCycle = (renderCycle + 1) % 341;
-    totalCycles++;
+void RICOH2C02::run(unsigned int cpuCycles)
+{
+    (this->*kernel)(3 * cpuCycles);
 }
 
-void RICOH2C02::clock3()
+void RICOH2C02::runDots(unsigned int dots)
+{
+    (this->*kernel)(dots);
+}
+
+unsigned int RICOH2C02::dotsUntil(int line, int dot)
+{
+    const int frameDots = 262 * 341;
+    int now = scanline * 341 + renderCycle;
+    int target = line * 341 + dot;
+    int dots = target - now;
+    if (dots < 0)
+        dots += frameDots;
+    // dot 340 of the pre-render line is skipped while rendering
+    const int skipped = 261 * 341 + 340;
+    if ((PPUMASK.s || PPUMASK.b) && (now < skipped ? now + dots > skipped : now + dots > skipped + frameDots))
+        dots--;
+    return dots;
+}
+
+void RICOH2C02::setKernel(Kernel kernel)
 {
-    clock();
-    clock();
-    clock();
+    this->kernel = kernel;
+}
+
+void RICOH2C02::setRenderMode(RenderMode mode)
+{
+    renderMode = mode;
+}
+
+void RICOH2C02::setSkipOutput(bool skip)
+{
+    skipOutput = skip;
+}
+
+void RICOH2C02::setFrameCallback(std::function<void()> callback)
+{
+    frameCallback = callback;
+}
+
+void RICOH2C02::frameDone()
+{
+    frameCount++;
+    if (skipOutput) // nothing drawn, keep the last published frame
+        return;
+    frame.swapBuffer();
+    if (frameCallback)
+        frameCallback();
+}
+
+template <class M>
+void RICOH2C02::runWith(unsigned int dots)
+{
+    for (; dots > 0; dots--)
+    {
+        // the whole line is ours, nobody can observe the dots in between
+        if (renderMode == RENDER_SCANLINE && renderCycle == 0 && scanline <= 239 && dots >= 341)
+        {
+            renderLine<M>();
+            if (scanline == 239)
+                frameDone();
+            scanline++;
+            totalCycles += 341;
+            dots -= 340; // the loop takes the last one
+            continue;
+        }
+
+        // Render background and sprites
+        render<M>();
+
+        // Sprite Evaluation
+        spriteEval();
+
+        if (scanline == 239 && renderCycle == 256)
+            frameDone();
+        if (scanline == 261 && renderCycle == 339 && (PPUMASK.s || PPUMASK.b))
+            renderCycle++; // skip one cycle
+        if (scanline == 261 && renderCycle == 340)
+            oddFlag = !oddFlag;
+        if (renderCycle == 340)
+            scanline = (scanline + 1) % 262;
+        renderCycle = (renderCycle + 1) % 341;
+        totalCycles++;
+    }
 }
 
 void RICOH2C02::reset()
 {
-    totalCycles = -3 * 7; // wait cpu to reset
-    renderCycle = -3 * 7; // wait cpu to reset
+    // the scheduler holds the ppu back while the cpu runs its reset sequence
+    totalCycles = 0;
+    renderCycle = 0;
 }
 
 bool RICOH2C02::ok()
@@ -295,19 +412,83 @@ bool RICOH2C02::ok()
     return scanline > 239;
 }
 
-unsigned char *RICOH2C02::rendered()
+bool RICOH2C02::rendered(unsigned char *out, Frame::Format format)
 {
-    return frame.getRawImage();
+    if (!frame.acquire())
+        return false; // out still holds the last one
+    frame.convert(out, format, colourTable);
+    return true;
 }
 
+// https://www.nesdev.org/wiki/PPU_palettes
+// a .pal file is 64 RGB triples, or 512 with one block of 64 for every emphasis combination
+// in PPUMASK bit order (red, green, blue)
 bool RICOH2C02::initColourTable(const std::string path)
 {
-    return false;
+    int entries = 64;
+    if (path.empty())
+        memcpy(colourTable, defaultColours, sizeof(defaultColours));
+    else
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file)
+        {
+            std::cerr << "Cannot open palette " << path << std::endl;
+            return false;
+        }
+        std::streamsize size = file.tellg();
+        if (size != 64 * 3 && size != 512 * 3)
+        {
+            std::cerr << "Palette " << path << " should be 192 or 1536 bytes, got " << size << std::endl;
+            return false;
+        }
+        uint8_t table[8][64][3];
+        file.seekg(0);
+        file.read((char *)table, size);
+        entries = (size / 3);
+        memcpy(colourTable, table, size);
+        std::cout << "Palette loaded from " << path << std::endl;
+    }
+    if (entries == 64)
+    {
+        // https://www.nesdev.org/wiki/Colour_emphasis
+        // every emphasis bit darkens the two other channels, the blacks in columns $xE and $xF stay black
+        const double attenuation = 0.816328;
+        for (int e = 1; e < 8; e++)
+        {
+            for (int i = 0; i < 64; i++)
+            {
+                for (int c = 0; c < 3; c++)
+                {
+                    double value = colourTable[0][i][c];
+                    if ((i & 0x0E) != 0x0E)
+                    {
+                        for (int bit = 0; bit < 3; bit++)
+                        {
+                            if (bit != c && (e & (1 << bit)))
+                                value *= attenuation;
+                        }
+                    }
+                    colourTable[e][i][c] = (uint8_t)(value + 0.5);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void RICOH2C02::maskChanged()
+{
+    // swap the whole table instead of looking at the emphasis bits for every pixel
+    colours = colourTable[(*(uint8_t*)&PPUMASK) >> 5];
+    greyMask = (PPUMASK.GS ? 0x30 : 0x3F);
 }
 
 void RICOH2C02::setOAM(int spr, int b, uint8_t value)
 {
     OAM[spr][b] = value;
+    if (b == 0)
+        lineSpritesDirty = true;
 }
 
 uint8_t RICOH2C02::getOAM(int spr, int b)
@@ -351,20 +532,15 @@ void RICOH2C02::fineYInc()
     }
 }
 
+template <class M>
 void RICOH2C02::render()
 {
     // each clock cycle produces one pixel
     // The PPU renders 262 scanlines per frame
     // Each scanline lasts for 341 PPU clock cycles
     // 1 CPU cycle = 3 PPU cycles
-    static uint8_t latch[4];
-    static uint16_t addr; // temp addr
-    static uint16_t sAddr; // sprite pattern addr
-    static uint8_t pAddr; // palette addr for background
-    static uint8_t aOffset; // attribute offset for background
-    static uint8_t cR, cG, cB;
-    static uint8_t renderFlag;
-    static uint8_t X0 = X;
+    uint8_t pAddr; // palette addr for background
+    uint8_t renderFlag;
 
     /*
     every 8 cycles:
@@ -377,42 +553,11 @@ void RICOH2C02::render()
 
 
     renderFlag = ((PPUMASK.s << 1) | PPUMASK.b);
-    if (totalCycles < 0 || renderCycle < 0)
-    {
-
-    }
-    else if (scanline == 261 || scanline <= 239) // visible scanlines
+    if (scanline == 261 || scanline <= 239) // visible scanlines
     {
         if (renderCycle == 0)
         {
-            // fetch 8x8 sprite data
-            for (int i = curSpriteCounter - 1; i >= 0; i--)
-            {
-                uint8_t pOffset = scanline - OAMcur[i][0];
-                uint16_t tempAddr;
-                if (OAMcur[i][2] & 0x80) // flip sprite vertically
-                    pOffset = (PPUCTRL.H ? 15 : 7) - pOffset;
-                if (!PPUCTRL.H)
-                    tempAddr = ((PPUCTRL.S << 12) | (OAMcur[i][1] << 4) | pOffset);
-                else
-                {
-                    if (pOffset <= 7)
-                        tempAddr = (((OAMcur[i][1] & 0x01) << 12) | ((OAMcur[i][1] & 0xFE) << 4) | pOffset);
-                    else
-                        tempAddr = (((OAMcur[i][1] & 0x01) << 12) | ((OAMcur[i][1] & 0xFE) << 4) | (pOffset & 0x07) | 0x10);
-                }
-                uint8_t sprLow = read(tempAddr);
-                uint8_t sprHigh = read(tempAddr + 8);
-                for (int j = 0; j < 8; j++)
-                {
-                    if (OAMcur[i][2] & 0x40) // flip sprite horizontally
-                        sprPalleteInd[i][j] = (((sprHigh << 1) & 0x02) | (sprLow & 0x01));
-                    else
-                        sprPalleteInd[i][7 - j] = (((sprHigh << 1) & 0x02) | (sprLow & 0x01));
-                    sprHigh >>= 1;
-                    sprLow >>= 1;
-                }
-            }
+            fetchSprites<M>();
         }
         else if (renderCycle <= 256)
         {
@@ -423,77 +568,53 @@ void RICOH2C02::render()
                 bool bgFlag = false;
                 if (renderBg && scanline != 261 && PPUMASK.b && (renderCycle > 8 || PPUMASK.m)) // background
                 {
-                    int offset = ((7 - stage) - X0);
-                    if (offset < 0)
-                        offset += 16;
-                    uint8_t bgLow = ((bgShiftReg16[0] >> offset) & 0x01);
-                    uint8_t bgHigh = (((bgShiftReg16[1] >> offset) & 0x01) << 1);
-
-                    pAddr = ((bgPalette[offset > 7 ? 1 : 0] << 2) | bgHigh | bgLow);
-                    if (pAddr & 0x03)
-                        bgFlag = true;
+                    int ind = stage + X0; // 0-7 current tile, 8-15 next tile
+                    pAddr = ((bgWindow[ind >> 3] >> ((ind & 0x07) << 3)) & 0xFF);
                     // it seems although 04, 08 and 1c maybe different from 00(the background)
                     // but during rendering, just treat them as background colour
-                    if (!bgHigh && !bgLow)
-                        pAddr = 0;
-                    std::tie(cR, cG, cB) = evalColour(readPalette(pAddr));
-                    frame.setColor(scanline, renderCycle - 1, cR, cG, cB);
+                    bgFlag = (pAddr != 0);
+                    if (!skipOutput)
+                        frame.setPixel(scanline, renderCycle - 1, readPalette(pAddr) & greyMask);
                 }
                 // is there visual persistence?
                 else if (scanline != 261)
                 {
-                    frame.setColor(scanline, renderCycle - 1, 0, 0, 0);
+                    if (!skipOutput)
+                        frame.setPixel(scanline, renderCycle - 1, Frame::BLACK);
                     pAddr = 0;
                 }
+                if (scanline != 261 && !skipOutput)
+                    frame.setEmphasis(scanline, (*(uint8_t*)&PPUMASK) >> 5);
 
                 /* sprite */
                 if (renderSpr && scanline != 261 && PPUMASK.s && (renderCycle > 8 || PPUMASK.M))
                 {
-                    for (int i = curSpriteCounter - 1; i >= 0; i--)
-                    {
-                        if (OAMcur[i][3] <= renderCycle - 1 && OAMcur[i][3] + 7 >= renderCycle - 1)
-                        {
-                            sAddr = (0x10 | ((OAMcur[i][2] << 2) & 0x0C) | sprPalleteInd[i][renderCycle - 1 - OAMcur[i][3]]);
-                            if ((!(OAMcur[i][2] & 0x20) || !bgFlag) && sprPalleteInd[i][renderCycle - 1 - OAMcur[i][3]]) // sprite in foreground
-                            {
-                                std::tie(cR, cG, cB) = evalColour(readPalette(sAddr));
-                                frame.setColor(scanline, renderCycle - 1, cR, cG, cB);
-                            }
-                            if (renderFlag == 3 && bgFlag && sprPalleteInd[i][renderCycle - 1 - OAMcur[i][3]] && curSpr0Ind == i && renderCycle != 256)
-                                PPUSTATUS.S = 1;
-                        }
-                    }
+                    uint8_t spr = sprLine[renderCycle - 1];
+                    if (spr && (!(spr & 0x20) || !bgFlag) && !skipOutput) // sprite in foreground
+                        frame.setPixel(scanline, renderCycle - 1, readPalette(spr & 0x1F) & greyMask);
+                    if (renderFlag == 3 && bgFlag && (spr & 0x40) && renderCycle != 256)
+                        PPUSTATUS.S = 1;
                 }
                 switch (stage)
                 {
                 case 1: // nametable entry
-                    addr = (0x2000 | (V & 0x0FFF));
-                    latch[0] = read(addr);
+                    fetchAddr = (0x2000 | (V & 0x0FFF));
+                    latch[0] = read<M>(fetchAddr);
                     break;
                 case 3: // attribute table(palette information)
-                    addr = ((0x23C0 | (V & 0x0C00) | ((V >> 4) & 0x38) | ((V >> 2) & 0x07)));
-                    latch[1] = read(addr);
-                    aOffset = (((V >> 5) & 0x02) | ((V >> 1) & 0x01)); // position in an attribute block
+                    fetchAddr = ((0x23C0 | (V & 0x0C00) | ((V >> 4) & 0x38) | ((V >> 2) & 0x07)));
+                    latch[1] = read<M>(fetchAddr);
+                    attrOffset = (((V >> 5) & 0x02) | ((V >> 1) & 0x01)); // position in an attribute block
+                    break;
                 case 5: // pattern table low byte
-                    addr = ((PPUCTRL.B << 12) | (latch[0] << 4) | ((V >> 12) & 0x07));
-                    latch[2] = read(addr);
+                    fetchAddr = ((PPUCTRL.B << 12) | (latch[0] << 4) | ((V >> 12) & 0x07));
                     break;
-                case 7: // pattern table high byte
-                    addr += 8;
-                    latch[3] = read(addr);
+                case 7: // pattern table high byte, both planes come decoded from the tile cache
+                    loadTile(bus->tileRow<M>(fetchAddr, false), (latch[1] >> (attrOffset << 1)) & 0x03);
                     break;
                 default:
                     break;
                 }
-                if (stage == 7)
-                {
-                    bgShiftReg16[0] >>= 8;
-                    bgShiftReg16[1] >>= 8;
-                    bgShiftReg16[0] |= (static_cast<uint16_t>(latch[2]) << 8);
-                    bgShiftReg16[1] |= (static_cast<uint16_t>(latch[3]) << 8);
-                    bgPalette[0] = bgPalette[1];
-                    bgPalette[1] = ((latch[1] >> (aOffset << 1)) & 0x03);
-                }
             }
         }
         else if (renderCycle <= 320)
@@ -508,34 +629,23 @@ void RICOH2C02::render()
                 switch (stage)
                 {
                 case 1: // nametable entry
-                    addr = (0x2000 | (V & 0x0FFF));
-                    latch[0] = read(addr);
+                    fetchAddr = (0x2000 | (V & 0x0FFF));
+                    latch[0] = read<M>(fetchAddr);
                     break;
                 case 3: // attribute table(palette information)
-                    addr = ((0x23C0 | (V & 0x0C00) | ((V >> 4) & 0x38) | ((V >> 2) & 0x07)));
-                    latch[1] = read(addr);
-                    aOffset = (((V >> 5) & 0x02) | ((V >> 1) & 0x01)); // position in an attribute block
+                    fetchAddr = ((0x23C0 | (V & 0x0C00) | ((V >> 4) & 0x38) | ((V >> 2) & 0x07)));
+                    latch[1] = read<M>(fetchAddr);
+                    attrOffset = (((V >> 5) & 0x02) | ((V >> 1) & 0x01)); // position in an attribute block
                     break;
                 case 5: // pattern table low byte
-                    addr = ((PPUCTRL.B << 12) | (latch[0] << 4) | ((V >> 12) & 0x07));
-                    latch[2] = read(addr);
+                    fetchAddr = ((PPUCTRL.B << 12) | (latch[0] << 4) | ((V >> 12) & 0x07));
                     break;
-                case 7: // pattern table high byte
-                    addr += 8;
-                    latch[3] = read(addr);
+                case 7: // pattern table high byte, both planes come decoded from the tile cache
+                    loadTile(bus->tileRow<M>(fetchAddr, false), (latch[1] >> (attrOffset << 1)) & 0x03);
                     break;
                 default:
                     break;
                 }
-                if (stage == 7)
-                {
-                    bgShiftReg16[0] >>= 8;
-                    bgShiftReg16[1] >>= 8;
-                    bgShiftReg16[0] |= (static_cast<uint16_t>(latch[2]) << 8);
-                    bgShiftReg16[1] |= (static_cast<uint16_t>(latch[3]) << 8);
-                    bgPalette[0] = bgPalette[1];
-                    bgPalette[1] = ((latch[1] >> (aOffset << 1)) & 0x03);
-                }
             }
         }
         else
@@ -580,7 +690,7 @@ void RICOH2C02::render()
         {
             PPUSTATUS.V = 1;
             if (PPUCTRL.V)
-                bus->nmi();
+                bus->nmi(); // serviced by the cpu at the next instruction boundary
         }
     }
     else
@@ -589,21 +699,167 @@ void RICOH2C02::render()
     }
 }
 
+template <class M>
+void RICOH2C02::fetchSprites()
+{
+    // fetch 8x8 sprite data
+    for (int i = curSpriteCounter - 1; i >= 0; i--)
+    {
+        uint8_t pOffset = scanline - OAMcur[i][0];
+        uint16_t tempAddr;
+        if (OAMcur[i][2] & 0x80) // flip sprite vertically
+            pOffset = (PPUCTRL.H ? 15 : 7) - pOffset;
+        if (!PPUCTRL.H)
+            tempAddr = ((PPUCTRL.S << 12) | (OAMcur[i][1] << 4) | pOffset);
+        else
+        {
+            if (pOffset <= 7)
+                tempAddr = (((OAMcur[i][1] & 0x01) << 12) | ((OAMcur[i][1] & 0xFE) << 4) | pOffset);
+            else
+                tempAddr = (((OAMcur[i][1] & 0x01) << 12) | ((OAMcur[i][1] & 0xFE) << 4) | (pOffset & 0x07) | 0x10);
+        }
+        if (!(tempAddr & 0x08)) // a proper row of a tile, take it from the tile cache
+        {
+            std::copy_n(bus->tileRow<M>(tempAddr, OAMcur[i][2] & 0x40), 8, sprPalleteInd[i]);
+            continue;
+        }
+        // out of range row (sprite size changed after evaluation), the planes straddle two rows
+        uint8_t sprLow = read<M>(tempAddr);
+        uint8_t sprHigh = read<M>(tempAddr + 8);
+        for (int j = 0; j < 8; j++)
+        {
+            if (OAMcur[i][2] & 0x40) // flip sprite horizontally
+                sprPalleteInd[i][j] = (((sprHigh << 1) & 0x02) | (sprLow & 0x01));
+            else
+                sprPalleteInd[i][7 - j] = (((sprHigh << 1) & 0x02) | (sprLow & 0x01));
+            sprHigh >>= 1;
+            sprLow >>= 1;
+        }
+    }
+    compositeSprites();
+}
+
+// https://www.nesdev.org/wiki/PPU_sprite_priority
+// the first opaque sprite pixel wins, and only then its priority bit decides against the background,
+// so a sprite behind the background still hides the sprites after it
+void RICOH2C02::compositeSprites()
+{
+    std::fill(sprLine, sprLine + 256, 0);
+    for (int i = curSpriteCounter - 1; i >= 0; i--)
+    {
+        for (int j = 0; j < 8 && OAMcur[i][3] + j < 256; j++)
+        {
+            uint8_t ind = sprPalleteInd[i][j];
+            if (!ind)
+                continue;
+            // palette address, priority bit where OAM has it, sprite 0
+            sprLine[OAMcur[i][3] + j] = (0x10 | ((OAMcur[i][2] << 2) & 0x0C) | ind | (OAMcur[i][2] & 0x20) | (curSpr0Ind == i ? 0x40 : 0));
+        }
+    }
+}
+
+template <class M>
+void RICOH2C02::fetchTile()
+{
+    // the four fetches of dots 1-8 of a tile, then move the pixel window along
+    // the attribute fetch is replaced by the palette map the bus keeps up to date
+    fetchAddr = (0x2000 | (V & 0x0FFF));
+    latch[0] = read<M>(fetchAddr);
+    fetchAddr = ((PPUCTRL.B << 12) | (latch[0] << 4) | ((V >> 12) & 0x07));
+    loadTile(bus->tileRow<M>(fetchAddr, false), bus->tilePalette(V));
+}
+
+// 8 pattern pixels (0-3) and their attribute into 8 background palette addresses at once, pixel i in byte i
+// a transparent pixel stays 0 whatever the attribute, it shows the backdrop colour
+// (the byte order is little endian, like every target this builds for)
+static inline uint64_t bgRow(const uint8_t *pixels, uint8_t attribute)
+{
+    uint64_t row;
+    memcpy(&row, pixels, 8);
+    uint64_t opaque = (((row | (row >> 1)) & 0x0101010101010101ULL) * 0x0C); // 0x0C in every opaque byte
+    return (row | (opaque & (attribute * 0x0404040404040404ULL)));
+}
+
+void RICOH2C02::loadTile(const uint8_t *pixels, uint8_t palette)
+{
+    bgWindow[0] = bgWindow[1];
+    bgWindow[1] = bgRow(pixels, palette);
+}
+
+// draws a whole visible scanline in one pass
+// same result as running render<M>() and spriteEval() for dots 0-340,
+// only valid if nothing touches the ppu before the line is over
+template <class M>
+void RICOH2C02::renderLine()
+{
+    uint8_t renderFlag = ((PPUMASK.s << 1) | PPUMASK.b);
+    fetchSprites<M>();
+    if (renderFlag)
+    {
+        bool showBg = renderBg && PPUMASK.b;
+        bool showSpr = renderSpr && PPUMASK.s;
+        // a skipped frame only needs what the cpu can see: sprite 0 hit and the fetches moving V along
+        bool draw = (!skipOutput || (renderFlag == 3 && showSpr && curSpr0Ind >= 0));
+        uint8_t scratch[256];
+        uint8_t *pixels = scratch;
+        if (!skipOutput)
+        {
+            pixels = frame.line(scanline);
+            frame.setEmphasis(scanline, (*(uint8_t*)&PPUMASK) >> 5);
+        }
+        // colour of each background palette address, the palette can't change before the line is over
+        uint8_t bgColour[16];
+        for (int i = 0; i < 16; i++)
+            bgColour[i] = (readPalette(i) & greyMask);
+        for (int tile = 0; tile < 32; tile++)
+        {
+            // the 8 pixels of this step start X0 pixels into the current tile, one funnel shift over both tiles
+            uint64_t row = (X0 ? ((bgWindow[0] >> (X0 << 3)) | (bgWindow[1] << (64 - (X0 << 3)))) : bgWindow[0]);
+            if (!showBg || (tile == 0 && !PPUMASK.m))
+                row = 0;
+            for (int stage = 0; draw && stage < 8; stage++, row >>= 8)
+            {
+                int x = (tile << 3) | stage;
+                uint8_t pAddr = (row & 0xFF);
+                bool bgFlag = (pAddr != 0);
+                if (showBg && (x >= 8 || PPUMASK.m))
+                    pixels[x] = bgColour[pAddr];
+                else
+                    pixels[x] = Frame::BLACK;
+                if (showSpr && (x >= 8 || PPUMASK.M))
+                {
+                    uint8_t spr = sprLine[x];
+                    if (spr && (!(spr & 0x20) || !bgFlag))
+                        pixels[x] = (readPalette(spr & 0x1F) & greyMask);
+                    if (renderFlag == 3 && bgFlag && (spr & 0x40) && x != 255)
+                        PPUSTATUS.S = 1;
+                }
+            }
+            fetchTile<M>();
+            coarseXInc();
+        }
+        fineYInc(); // dot 256
+        V = ((T & 0x041F) | (V & (~0x041F))); // dot 257
+        fetchTile<M>(); // dots 321-328, first two tiles of the next line
+        coarseXInc();
+        fetchTile<M>(); // dots 329-336
+        coarseXInc();
+    }
+    X0 = X;
+    spriteEvalLine();
+}
+
 // https://www.nesdev.org/wiki/PPU_sprite_evaluation
 void RICOH2C02::spriteEval() // cycle chart is not accurate
 {
     // just a state machine
-    static int n;
-    static int p; // for copy
-    static int stage;
+    int &n = evalN;
+    int &p = evalP; // for copy
+    int &stage = evalStage;
     bool renderFlag = (PPUMASK.s || PPUMASK.b);
     if (scanline > 239 || !renderFlag) // sprite evaluation takes place during all visible scanlines
         return;
-    if (totalCycles < 0 || renderCycle < 0)
-    {
-
-    }
-    else if (renderCycle == 0)
+    if (renderCycle == 0)
     {
         n = p = 0;
         spriteCounter = 0;
@@ -673,6 +929,71 @@ void RICOH2C02::spriteEval() // cycle chart is not accurate
     }
 }
 
+// bit n of lineSprites[line] is set if OAM[n] is in range on line
+// OAM only changes through DMA or $2004, at most a few times a frame, so spriteEvalLine()
+// reads the index instead of comparing all 64 sprites on every line
+void RICOH2C02::indexSprites()
+{
+    std::fill(lineSprites, lineSprites + 256, 0);
+    int height = (PPUCTRL.H ? 15 : 7);
+    for (int n = 0; n < 64; n++)
+    {
+        for (int line = OAM[n][0]; line <= OAM[n][0] + height && line < 256; line++)
+            lineSprites[line] |= (1ULL << n);
+    }
+    lineSpritesDirty = false;
+}
+
+// spriteEval() for dots 0-340 of a visible scanline in one go
+void RICOH2C02::spriteEvalLine()
+{
+    bool renderFlag = (PPUMASK.s || PPUMASK.b);
+    if (scanline > 239 || !renderFlag)
+        return;
+    if (lineSpritesDirty)
+        indexSprites();
+    uint64_t inRange = lineSprites[scanline + 1];
+    // dots 1-64: clear secondary OAM
+    std::fill((uint8_t*)OAMnext, (uint8_t*)OAMnext + 32, 0xFF);
+    // dots 65-256: sprite evaluation, the first 8 sprites in range are copied
+    int examined = 64; // sprites looked at before secondary OAM was full
+    spriteCounter = 0;
+    spr0Ind = -1;
+    for (uint64_t left = inRange; left && spriteCounter < 8; left &= (left - 1))
+    {
+        int n = ctz64(left);
+        std::copy_n(OAM[n], 4, OAMnext[spriteCounter]);
+        spr0Ind = (n == 0 ? spriteCounter : spr0Ind);
+        spriteCounter++;
+        if (spriteCounter == 8)
+            examined = n + 1;
+    }
+    // the evaluation writes the Y of every sprite it looks at into the free slot, the last one stays
+    if (spriteCounter < 8 && !(inRange >> 63))
+        OAMnext[spriteCounter][0] = OAM[63][0];
+    // overflow: any sprite after the 8th in range, spriteEval() still checks them one per dot
+    if (examined < 64 && (inRange >> examined))
+        PPUSTATUS.O = 1;
+    // dots 257-320: sprite fetches, copy into the list for the next line
+    int p = 0;
+    for (int cycle = 257; cycle <= 320; cycle++)
+    {
+        if (p == (spriteCounter << 2))
+        {
+            *((uint8_t*)OAMcur + p) = OAM[63][0];
+            p++;
+        }
+        else if ((cycle - 1) % 8 <= 3)
+        {
+            *((uint8_t*)OAMcur + p) = *((uint8_t*)OAMnext + p);
+            p++;
+        }
+    }
+    curSpriteCounter = spriteCounter;
+    curSpr0Ind = spr0Ind;
+    OAMADDR = 0;
+}
+
 uint8_t RICOH2C02::read(uint16_t addr)
 {
     if (addr >= 0x3F00 && addr <= 0x3FFF)
@@ -681,6 +1002,12 @@ uint8_t RICOH2C02::read(uint16_t addr)
         return bus->ppuRead(addr);
 }
 
+template <class M>
+uint8_t RICOH2C02::read(uint16_t addr)
+{
+    return bus->ppuRead<M>(addr);
+}
+
 void RICOH2C02::write(uint16_t addr, uint8_t value)
 {
     if (addr >= 0x3F00 && addr <= 0x3FFF)
@@ -709,6 +1036,7 @@ uint8_t RICOH2C02::readPalette(uint16_t addr)
 void RICOH2C02::writePalette(uint16_t addr, uint8_t value)
 {
     addr = (addr & 0x1F);
+    value &= 0x3F; // palette RAM is 6 bits wide
     uint8_t pixelInd = (addr & 0x03);
     if (!pixelInd)
         palette[addr & 0xEF] = value;
@@ -718,7 +1046,7 @@ void RICOH2C02::writePalette(uint16_t addr, uint8_t value)
 
 std::tuple<uint8_t, uint8_t, uint8_t> RICOH2C02::evalColour(uint8_t colorInd)
 {
-    return std::make_tuple(colourTable[colorInd][0], colourTable[colorInd][1], colourTable[colorInd][2]);
+    return std::make_tuple(colours[colorInd][0], colours[colorInd][1], colours[colorInd][2]);
 }
 
 void RICOH2C02::evalNametable(int id)
@@ -727,22 +1055,25 @@ void RICOH2C02::evalNametable(int id)
     {
         uint16_t addr = ((id << 10) | i);
         uint8_t entry = read(0x2000 | addr);
+        uint8_t tilePalette = (bus->tilePalette(0x2000 | addr) << 2);
         uint16_t startAddr = ((static_cast<uint16_t>(PPUCTRL.B) << 12) | (static_cast<uint16_t>(entry) << 4));
         for (int row = 0; row < 8; row++)
         {
-            uint8_t patternLow = read(startAddr + row);
-            uint8_t patternHigh = read(startAddr + row + 8);
+            const uint8_t *pixels = bus->tileRow(startAddr + row, false);
             int sy = (i >> 5);
             int sx = (i & 0x1F);
             for (int col = 0; col < 8; col++)
             {
-                int ind = ((sy << 11) + (sx << 3)) + ((row << 8) + 7 - col);
+                int ind = ((sy << 11) + (sx << 3)) + ((row << 8) + col);
                 std::tie(tileBuffer[id][ind][0], tileBuffer[id][ind][1], tileBuffer[id][ind][2]) =
-                    evalColour(readPalette(((patternHigh & 0x01) << 1) | (patternLow & 0x01)));
-                patternHigh >>= 1;
-                patternLow >>= 1;
+                    evalColour(readPalette(pixels[col] ? (tilePalette | pixels[col]) : 0));
             }
         }
     }
 }
 
+// one rendering loop per supported mapper, see Mapper::ppuKernel()
+template void RICOH2C02::runWith<Mapper>(unsigned int);
+template void RICOH2C02::runWith<Mapper000>(unsigned int);
+template void RICOH2C02::runWith<Mapper001>(unsigned int);
+template void RICOH2C02::runWith<Mapper002>(unsigned int);
@@ -4,6 +4,7 @@
 #include "bus.h"
 #include "frame.h"
 #include <cstdint>
+#include <functional>
 #include <string>
 #include <tuple>
 
@@ -17,12 +18,44 @@ public:
     void writeReg(uint16_t addr, uint8_t value);
     void clock(); // let ppu run 1 clock cycle (1 cpu cycle = 3 ppu cycle)
     void clock3(); // let ppu run 1 clock cycle (1 cpu cycle = 3 ppu cycle)
+    void run(unsigned int cpuCycles); // catch up with cpu after it ran cpuCycles cycles
+    void runDots(unsigned int dots); // run dots ppu cycles, used by the scheduler
+    unsigned int dotsUntil(int line, int dot); // ppu cycles to run before (line, dot) is the next one, less than one frame
     void reset();
     bool ok();
-    unsigned char *rendered();
+    bool rendered(unsigned char *out, Frame::Format format = Frame::FORMAT_RGB888); // newest finished frame in RGB for the presentation side, false if nothing new
+
+public:
+    // the rendering loop is instantiated for every concrete mapper type,
+    // so that pattern and nametable fetches do not go through virtual calls
+    // Bus::connectMapper() installs the one that matches the cartridge
+    using Kernel = void (RICOH2C02::*)(unsigned int);
+    template <class M> void runWith(unsigned int dots); // run dots ppu cycles
+    void setKernel(Kernel kernel);
+
+    // RENDER_SCANLINE draws a visible line in one pass whenever the ppu is asked to run
+    // across the whole line, which means no register, VRAM or mapper write landed in it
+    // everything else, and lines the cpu touches midway, goes through the dot renderer
+    enum RenderMode
+    {
+        RENDER_DOT,
+        RENDER_SCANLINE
+    };
+    void setRenderMode(RenderMode mode);
+    // called on the emulation thread right after a finished frame is published,
+    // keep it short, the presentation side should pick the frame up on its own thread
+    void setFrameCallback(std::function<void()> callback);
+    // frame skipping: frames are still emulated, sprite 0 hit included, but no pixel is stored
+    // and nothing is published, takes effect from the next scanline
+    void setSkipOutput(bool skip);
 
 private:
     Bus *bus;
+    Kernel kernel;
+    RenderMode renderMode;
+    std::function<void()> frameCallback;
+    bool skipOutput;
+    void frameDone(); // last visible scanline finished
 
 public:
     /*
@@ -121,13 +154,18 @@ private:
     uint8_t palette[32];
 
 private:
-    uint8_t colourTable[64][3];
-    bool initColourTable(const std::string path);
+    uint8_t colourTable[8][64][3]; // [emphasis][colour]
+    const uint8_t (*colours)[3]; // colourTable of the current emphasis
+    uint8_t greyMask; // $30 in greyscale mode, $3F otherwise
+    void maskChanged(); // PPUMASK written
+public:
+    bool initColourTable(const std::string path); // load a .pal file, empty path for the built-in colours
 
 public: // for rendering
     int scanline; // current scanline
     int renderCycle;
     long long totalCycles;
+    unsigned long long frameCount; // frames completed so far
     Frame frame;
     bool renderBg;
     bool renderSpr;
@@ -142,6 +180,9 @@ private:
     uint8_t OAMcur[8][4];
     uint8_t OAMnext[8][4];
     uint8_t sprPalleteInd[8][8];
+    // sprites of the current scanline composited per pixel, 0 if transparent
+    // bits 0-4 palette address, bit 5 behind background, bit 6 sprite 0
+    uint8_t sprLine[256];
     int spriteCounter;
     int spr0Ind;
     int curSpriteCounter;
@@ -154,18 +195,34 @@ public: // internal registers
     bool W;
 
 private: // backgound rendering
-    uint16_t bgShiftReg16[2]; // pattern table data for two tiles
-    // use current palette instead
-    // uint8_t bgShiftReg8[2]; // palette attributes for the lower 8 pixels of the 16-bit shift register
-    uint8_t bgPalette[2];
+    // palette addresses of the 8 pixels of the current tile and the next one, pixel i in byte i,
+    // replaces the two 16-bit shift registers and the attribute shift registers
+    uint64_t bgWindow[2];
+    uint8_t latch[2]; // nametable and attribute byte of the tile being fetched
+    uint16_t fetchAddr;
+    uint8_t attrOffset; // position in an attribute block
+    uint8_t X0; // fine x used for the current scanline
     void coarseXInc();
     void fineYInc();
-    void render();
+    template <class M> void render(); // one dot
+    template <class M> void renderLine(); // dots 0-340 of a visible scanline
+    template <class M> void fetchSprites(); // sprite patterns for the current scanline
+    void compositeSprites(); // sprite patterns into sprLine
+    template <class M> void fetchTile(); // next background tile into the shift registers
+    void loadTile(const uint8_t *pixels, uint8_t palette); // decoded row of the fetched tile into bgWindow
 private: // sprite rendering
+    int evalN; // sprite evaluation state
+    int evalP;
+    int evalStage;
     void spriteEval();
+    void spriteEvalLine();
+    uint64_t lineSprites[256]; // bit n: OAM[n] covers the line, see indexSprites()
+    bool lineSpritesDirty; // OAM Y or sprite size changed since the last indexSprites()
+    void indexSprites();
 
 private:
     uint8_t read(uint16_t addr); // read from bus
+    template <class M> uint8_t read(uint16_t addr); // read pattern or nametable through mapper M
     void write(uint16_t addr, uint8_t value); // write to bus
 
 public:
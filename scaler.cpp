@@ -0,0 +1,278 @@
+#include "scaler.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define SCALER_SSE2
+#endif
+
+// one output row of pixel repetition
+static void nearestRow(const uint32_t *src, uint32_t *dst, int width, int scale)
+{
+    int x = 0;
+#ifdef SCALER_SSE2
+    // 4 source pixels per step, spread with 32-bit shuffles
+    switch (scale)
+    {
+    case 2:
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+            _mm_storeu_si128((__m128i *)(dst + x * 2), _mm_unpacklo_epi32(v, v));
+            _mm_storeu_si128((__m128i *)(dst + x * 2 + 4), _mm_unpackhi_epi32(v, v));
+        }
+        break;
+    case 3:
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+            _mm_storeu_si128((__m128i *)(dst + x * 3), _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 0, 0)));
+            _mm_storeu_si128((__m128i *)(dst + x * 3 + 4), _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 2, 1, 1)));
+            _mm_storeu_si128((__m128i *)(dst + x * 3 + 8), _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 2)));
+        }
+        break;
+    case 4:
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+            _mm_storeu_si128((__m128i *)(dst + x * 4), _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 0, 0, 0)));
+            _mm_storeu_si128((__m128i *)(dst + x * 4 + 4), _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 1, 1, 1)));
+            _mm_storeu_si128((__m128i *)(dst + x * 4 + 8), _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 2, 2, 2)));
+            _mm_storeu_si128((__m128i *)(dst + x * 4 + 12), _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3)));
+        }
+        break;
+    default:
+        break;
+    }
+#endif
+    for (; x < width; x++)
+    {
+        for (int k = 0; k < scale; k++)
+            dst[x * scale + k] = src[x];
+    }
+}
+
+// copy of a row at half brightness, every channel shifted right once
+static void darkenRow(const uint32_t *src, uint32_t *dst, int width)
+{
+    int x = 0;
+#ifdef SCALER_SSE2
+    const __m128i mask = _mm_set1_epi32(0x7F7F7F7F);
+    for (; x + 4 <= width; x += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + x));
+        _mm_storeu_si128((__m128i *)(dst + x), _mm_and_si128(_mm_srli_epi32(v, 1), mask));
+    }
+#endif
+    for (; x < width; x++)
+        dst[x] = ((src[x] >> 1) & 0x7F7F7F7F);
+}
+
+// https://www.scale2x.it/algorithm
+// B above, D left, F right, H below E, out of range neighbours repeat the edge
+static void scale2xRow(const uint32_t *src, uint32_t *dst, int width, int height, int y)
+{
+    const uint32_t *above = src + std::max(y - 1, 0) * width;
+    const uint32_t *line = src + y * width;
+    const uint32_t *below = src + std::min(y + 1, height - 1) * width;
+    uint32_t *out0 = dst + (y * 2) * (width * 2);
+    uint32_t *out1 = out0 + width * 2;
+    for (int x = 0; x < width; x++)
+    {
+        uint32_t B = above[x], H = below[x], E = line[x];
+        uint32_t D = line[std::max(x - 1, 0)], F = line[std::min(x + 1, width - 1)];
+        uint32_t E0 = E, E1 = E, E2 = E, E3 = E;
+        if (B != H && D != F)
+        {
+            E0 = (D == B ? D : E);
+            E1 = (B == F ? F : E);
+            E2 = (D == H ? D : E);
+            E3 = (H == F ? F : E);
+        }
+        out0[x * 2] = E0;
+        out0[x * 2 + 1] = E1;
+        out1[x * 2] = E2;
+        out1[x * 2 + 1] = E3;
+    }
+}
+
+// A B C
+// D E F
+// G H I
+static void scale3xRow(const uint32_t *src, uint32_t *dst, int width, int height, int y)
+{
+    const uint32_t *above = src + std::max(y - 1, 0) * width;
+    const uint32_t *line = src + y * width;
+    const uint32_t *below = src + std::min(y + 1, height - 1) * width;
+    uint32_t *out0 = dst + (y * 3) * (width * 3);
+    uint32_t *out1 = out0 + width * 3;
+    uint32_t *out2 = out1 + width * 3;
+    for (int x = 0; x < width; x++)
+    {
+        int l = std::max(x - 1, 0), r = std::min(x + 1, width - 1);
+        uint32_t A = above[l], B = above[x], C = above[r];
+        uint32_t D = line[l], E = line[x], F = line[r];
+        uint32_t G = below[l], H = below[x], I = below[r];
+        uint32_t e[9] = {E, E, E, E, E, E, E, E, E};
+        if (B != H && D != F)
+        {
+            e[0] = (D == B ? D : E);
+            e[1] = ((D == B && E != C) || (B == F && E != A) ? B : E);
+            e[2] = (B == F ? F : E);
+            e[3] = ((D == B && E != G) || (D == H && E != A) ? D : E);
+            e[5] = ((B == F && E != I) || (H == F && E != C) ? F : E);
+            e[6] = (D == H ? D : E);
+            e[7] = ((D == H && E != I) || (H == F && E != G) ? H : E);
+            e[8] = (H == F ? F : E);
+        }
+        for (int k = 0; k < 3; k++)
+        {
+            out0[x * 3 + k] = e[k];
+            out1[x * 3 + k] = e[3 + k];
+            out2[x * 3 + k] = e[6 + k];
+        }
+    }
+}
+
+Scaler::Scaler(int threads)
+{
+    filter = FILTER_NEAREST;
+    scale = 1;
+    jobRows = 0;
+    jobParts = 1;
+    pending = 0;
+    generation = 0;
+    quit = false;
+    if (threads < 0)
+    {
+        // leave a core to the emulation and one to the gui
+        int cores = std::thread::hardware_concurrency();
+        threads = std::clamp(cores - 2, 0, 3);
+    }
+    for (int i = 1; i <= threads; i++)
+        workers.emplace_back(&Scaler::workerLoop, this, i);
+}
+
+Scaler::~Scaler()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers)
+        worker.join();
+}
+
+void Scaler::setFilter(Filter filter)
+{
+    this->filter = filter;
+}
+
+void Scaler::setScale(int scale)
+{
+    this->scale = std::clamp(scale, 1, MAX_SCALE);
+}
+
+int Scaler::getScale()
+{
+    return scale;
+}
+
+const uint32_t *Scaler::process(const uint32_t *src, int width, int height)
+{
+    int outWidth = width * scale;
+    output.resize((size_t)outWidth * height * scale);
+    uint32_t *dst = output.data();
+    if (filter == FILTER_SCALEX && scale == 2)
+        parallelRows(height, [&](int first, int last)
+        {
+            for (int y = first; y < last; y++)
+                scale2xRow(src, dst, width, height, y);
+        });
+    else if (filter == FILTER_SCALEX && scale == 3)
+        parallelRows(height, [&](int first, int last)
+        {
+            for (int y = first; y < last; y++)
+                scale3xRow(src, dst, width, height, y);
+        });
+    else if (filter == FILTER_SCALEX && scale == 4)
+    {
+        temp.resize((size_t)width * height * 4);
+        uint32_t *mid = temp.data();
+        parallelRows(height, [&](int first, int last)
+        {
+            for (int y = first; y < last; y++)
+                scale2xRow(src, mid, width, height, y);
+        });
+        parallelRows(height * 2, [&](int first, int last)
+        {
+            for (int y = first; y < last; y++)
+                scale2xRow(mid, dst, width * 2, height * 2, y);
+        });
+    }
+    else
+    {
+        bool scanlines = (filter == FILTER_SCANLINES && scale > 1);
+        parallelRows(height, [&](int first, int last)
+        {
+            for (int y = first; y < last; y++)
+            {
+                uint32_t *row = dst + (size_t)y * scale * outWidth;
+                nearestRow(src + y * width, row, width, scale);
+                for (int k = 1; k < scale; k++)
+                {
+                    if (scanlines && k == scale - 1)
+                        darkenRow(row, row + k * outWidth, outWidth);
+                    else
+                        memcpy(row + k * outWidth, row, outWidth * sizeof(uint32_t));
+                }
+            }
+        });
+    }
+    return dst;
+}
+
+void Scaler::parallelRows(int rows, const std::function<void(int, int)> &fn)
+{
+    int parts = workers.size() + 1;
+    if (parts == 1)
+    {
+        fn(0, rows);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        job = fn;
+        jobRows = rows;
+        jobParts = parts;
+        pending = parts - 1;
+        generation++;
+    }
+    wake.notify_all();
+    fn(0, rows / parts);
+    std::unique_lock<std::mutex> guard(lock);
+    finished.wait(guard, [this] { return pending == 0; });
+}
+
+void Scaler::workerLoop(int index)
+{
+    uint64_t seen = 0;
+    std::unique_lock<std::mutex> guard(lock);
+    while (true)
+    {
+        wake.wait(guard, [&] { return quit || generation != seen; });
+        if (quit)
+            return;
+        seen = generation;
+        int first = jobRows * index / jobParts;
+        int last = jobRows * (index + 1) / jobParts;
+        guard.unlock();
+        job(first, last);
+        guard.lock();
+        if (--pending == 0)
+            finished.notify_one();
+    }
+}
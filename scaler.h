@@ -0,0 +1,54 @@
+#ifndef SCALER_H
+#define SCALER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class Scaler // integer upscaling of 32-bit frames into a reusable buffer
+{
+public:
+    enum Filter
+    {
+        FILTER_NEAREST,     // plain pixel repetition
+        FILTER_SCANLINES,   // nearest, last row of every source line at half brightness
+        FILTER_SCALEX,      // edge aware Scale2x/Scale3x (4x is Scale2x twice)
+        FILTER_COUNT
+    };
+    static constexpr int MAX_SCALE = 4;
+
+public:
+    Scaler(int threads = -1); // extra worker threads, -1 picks from the core count
+    ~Scaler();
+    void setFilter(Filter filter);
+    void setScale(int scale); // 1 to MAX_SCALE
+    int getScale();
+    // scale a width x height image of 32-bit pixels, the result stays valid until the next call
+    // or until the scale changes
+    const uint32_t *process(const uint32_t *src, int width, int height);
+
+private:
+    Filter filter;
+    int scale;
+    std::vector<uint32_t> output;
+    std::vector<uint32_t> temp; // first Scale2x pass of 4x
+
+private: // small pool, every job is split by rows, the calling thread takes the first slice
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::function<void(int, int)> job;
+    int jobRows;
+    int jobParts;
+    int pending;
+    uint64_t generation;
+    bool quit;
+    void parallelRows(int rows, const std::function<void(int, int)> &fn); // fn(first, last) over [0, rows)
+    void workerLoop(int index);
+};
+
+#endif // SCALER_H
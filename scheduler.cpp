@@ -0,0 +1,156 @@
+#include "scheduler.h"
+#include "mos6502.h"
+#include "ricoh2c02.h"
+#include "bus.h"
+
+#include <algorithm>
+
+Scheduler::Scheduler()
+{
+    cpu = nullptr;
+    ppu = nullptr;
+    bus = nullptr;
+    ppuClock = 0;
+    std::fill(events, events + EVENT_COUNT, NEVER);
+}
+
+void Scheduler::connectAll(MOS6502 *cpu, RICOH2C02 *ppu, Bus *bus)
+{
+    this->cpu = cpu;
+    this->ppu = ppu;
+    this->bus = bus;
+    bus->connectScheduler(this);
+}
+
+void Scheduler::reset()
+{
+    // the cpu spends 7 cycles fetching the reset vector before the first instruction,
+    // the ppu starts counting once that is done
+    ppuClock = now() + 7 * CPU_DIVIDER;
+    std::fill(events, events + EVENT_COUNT, NEVER);
+    updatePPUEvents();
+}
+
+void Scheduler::schedule(Event event, uint64_t when)
+{
+    events[event] = when;
+}
+
+void Scheduler::cancel(Event event)
+{
+    events[event] = NEVER;
+}
+
+uint64_t Scheduler::now()
+{
+    // total_cycles is only advanced after an instruction completes,
+    // so during bus accesses this is the start of the current instruction
+    return cpu->total_cycles * CPU_DIVIDER;
+}
+
+uint64_t Scheduler::runUntil(uint64_t until)
+{
+    uint64_t start = now();
+    while (now() < until)
+    {
+        // one uninterrupted batch of instructions up to the next event,
+        // bus accesses pull the ppu along when they need it
+        uint64_t target = std::min(until, events[nextEvent()]);
+        if (now() < target)
+            cpu->run((target - now() + CPU_DIVIDER - 1) / CPU_DIVIDER);
+        for (int i = 0; i < EVENT_COUNT; i++)
+        {
+            if (events[i] <= now())
+                dispatch(static_cast<Event>(i));
+        }
+    }
+    return now() - start;
+}
+
+uint64_t Scheduler::runFrame()
+{
+    uint64_t start = now();
+    unsigned long long frame = ppu->frameCount;
+    // frame end is always pending, so this never runs away
+    while (ppu->frameCount == frame)
+        runUntil(events[nextEvent()]);
+    return now() - start;
+}
+
+unsigned int Scheduler::step()
+{
+    // the cpu services pending interrupts between instructions
+    unsigned int cycles = cpu->run(1);
+    syncPPU();
+    return cycles;
+}
+
+void Scheduler::clock()
+{
+    cpu->clock();
+    syncPPU();
+}
+
+Scheduler::Event Scheduler::nextEvent()
+{
+    int next = 0;
+    for (int i = 1; i < EVENT_COUNT; i++)
+    {
+        if (events[i] < events[next])
+            next = i;
+    }
+    return static_cast<Event>(next);
+}
+
+void Scheduler::dispatch(Event event)
+{
+    switch (event)
+    {
+    case EVENT_NMI: // the ppu sets vblank and raises nmi itself once it gets there
+        syncPPU();
+        events[EVENT_NMI] = predict(241, 1);
+        break;
+    case EVENT_SPRITE0:
+        syncPPU();
+        events[EVENT_SPRITE0] = predictSprite0();
+        break;
+    case EVENT_FRAME_END:
+        syncPPU();
+        events[EVENT_FRAME_END] = predict(240, 0);
+        break;
+    default:
+        break;
+    }
+}
+
+void Scheduler::syncPPU()
+{
+    uint64_t cpuClock = now();
+    if (cpuClock <= ppuClock)
+        return;
+    unsigned int dots = (cpuClock - ppuClock) / PPU_DIVIDER;
+    ppu->runDots(dots);
+    ppuClock += dots * PPU_DIVIDER;
+}
+
+void Scheduler::updatePPUEvents()
+{
+    events[EVENT_NMI] = predict(241, 1);
+    events[EVENT_SPRITE0] = predictSprite0();
+    events[EVENT_FRAME_END] = predict(240, 0);
+}
+
+uint64_t Scheduler::predict(int line, int dot)
+{
+    // the dot has to be run, not just reached
+    return ppuClock + (ppu->dotsUntil(line, dot) + 1) * uint64_t(PPU_DIVIDER);
+}
+
+uint64_t Scheduler::predictSprite0()
+{
+    // sprite data is delayed by one scanline, pixel x is output at dot x + 1
+    int line = ppu->getOAM(0, 0) + 1;
+    if (line > 239)
+        return NEVER;
+    return predict(line, ppu->getOAM(0, 3) + 1);
+}
@@ -0,0 +1,61 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <cstdint>
+
+class MOS6502;
+class RICOH2C02;
+class Bus;
+
+class Scheduler // one master clock for cpu, ppu and timed events
+{
+public:
+    // NTSC master clock runs at 21.477272 MHz
+    // cpu divides it by 12, ppu by 4 (1 cpu cycle = 3 ppu cycle)
+    static constexpr double MASTER_CLOCK = 236.25e6 / 11; // Hz
+    static constexpr unsigned int CPU_DIVIDER = 12;
+    static constexpr unsigned int PPU_DIVIDER = 4;
+    static constexpr uint64_t NEVER = UINT64_MAX;
+
+    enum Event
+    {
+        EVENT_NMI,          // vblank starts (line 241 dot 1)
+        EVENT_SPRITE0,      // earliest dot sprite 0 can hit
+        EVENT_FRAME_END,    // last visible scanline done (line 240 dot 0)
+        EVENT_COUNT
+    };
+
+public:
+    Scheduler();
+    void connectAll(MOS6502 *cpu, RICOH2C02 *ppu, Bus *bus);
+    void reset(); // call after cpu and ppu are reset
+    void schedule(Event event, uint64_t when); // when is in master ticks
+    void cancel(Event event);
+    uint64_t now(); // current master clock, start of the running cpu instruction
+    uint64_t runUntil(uint64_t until); // run until the master clock reaches until, return ticks passed
+    uint64_t runFrame(); // run until the next frame end, return ticks passed
+    unsigned int step(); // run one cpu instruction, return cpu cycles
+    void clock(); // run one cpu cycle, for debug
+
+    // the ppu is left behind while the cpu runs and only catches up when its state is needed:
+    // register access, OAMDMA, mapper register writes, and the events above
+    void syncPPU(); // let ppu catch up with the cpu
+    void updatePPUEvents(); // predict ppu events again after its registers or OAM changed
+
+private:
+    MOS6502 *cpu;
+    RICOH2C02 *ppu;
+    Bus *bus;
+    uint64_t ppuClock; // master ticks, the cpu clock is derived from MOS6502::total_cycles
+    // pending events, NEVER if not scheduled
+    // only a handful of sources, so a linear scan beats a heap
+    uint64_t events[EVENT_COUNT];
+
+private:
+    Event nextEvent();
+    void dispatch(Event event);
+    uint64_t predict(int line, int dot); // master time at which ppu has finished (line, dot)
+    uint64_t predictSprite0(); // top left corner of sprite 0, NEVER if it is off screen
+};
+
+#endif // SCHEDULER_H